@@ -0,0 +1,66 @@
+project "Bench"
+    kind "ConsoleApp"
+    language "C"
+    cdialect "C17"
+    staticruntime "off"
+
+    -- The engine sources without the game's entry point
+    files
+    {
+        "src/**.h",
+        "src/**.c",
+        "%{wks.location}/Doom/src/**.h",
+        "%{wks.location}/Doom/src/**.c"
+    }
+
+    removefiles
+    {
+        "%{wks.location}/Doom/src/main.c"
+    }
+
+    defines
+    {
+        "_CRT_SECURE_NO_WARNINGS"
+    }
+
+    includedirs
+    {
+        "src",
+        "%{wks.location}/Doom/src",
+        "%{wks.location}/vendor/glfw/include",
+        "%{wks.location}/vendor/glad/src/include"
+    }
+
+    libdirs
+    {
+        "%{wks.location}/vendor/glfw/lib"
+    }
+
+    links
+    {
+        "Glad"
+    }
+
+    debugdir "%{wks.location}/Doom"
+
+    targetdir ("%{wks.location}/bin/" .. outputdir .. "/%{prj.name}")
+    objdir ("%{wks.location}/bin-int/" .. outputdir .. "/%{prj.name}")
+
+    filter "system:windows"
+        systemversion "latest"
+        links { "glfw3.lib" }
+
+    -- The bundled glfw3.lib is Windows only, Linux uses the system GLFW (libglfw3-dev).
+    -- X11 is for -software, which presents through XPutImage instead of a GL context
+    filter "system:linux"
+        links { "glfw", "pthread", "EGL", "X11", "m" }
+
+    filter "configurations:Debug"
+        defines { "DEBUG" }
+        runtime "Debug"
+        symbols "On"
+
+    filter "configurations:Release"
+        defines { "RELEASE" }
+        runtime "Release"
+        optimize "On"
@@ -0,0 +1,440 @@
+#include "args.h"
+#include "darray.h"
+#include "headless.h"
+#include "thread_pool.h"
+#include "timer.h"
+#include "wad_loader.h"
+#include "engine/bsp.h"
+#include "engine/meshgen.h"
+#include "engine/state.h"
+#include "engine/utilities.h"
+#include "math/matrix.h"
+#include "math/vector.h"
+
+#include "glad/glad.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_REPORT "bench.json"
+#define DEFAULT_REPETITIONS 15
+#define WARMUP_REPETITIONS 3
+#define MIN_SAMPLE_SECONDS 0.01	// Iterations per sample double until one sample takes this long
+#define NUM_QUERY_POSITIONS 4096
+#define DARRAY_PUSH_COUNT 4096
+#define WALK_STEP 8.0f		// Map units between walk positions, about a tic of running
+
+typedef void (*bench_kernel)(int iterations);
+
+typedef struct bench_result
+{
+	const char* name;
+	int items;		// Units of work per iteration, per_item_ns divides by it
+	int iterations;		// Per sample
+	int repetitions;
+	double min_ns, median_ns, mean_ns, stddev_ns; // Per iteration
+} bench_result;
+
+static void run(const char* name, bench_kernel kernel, int items);
+static double time_sample(bench_kernel kernel, int iterations);
+static int compare_doubles(const void* a, const void* b);
+static bool load_map(const char* mapname);
+static void write_report(FILE* file);
+
+static void bench_find_lump(int iterations);
+static void bench_read_patch(int iterations);
+static void bench_read_textures(int iterations);
+static void bench_read_map(int iterations);
+static void bench_generate_meshes(int iterations);
+static void bench_map_get_sector(int iterations);
+static void bench_bsp_locate(int iterations);
+static void bench_bsp_locate_from(int iterations);
+static void bench_bsp_locate_batch(int iterations);
+static void bench_mat4_mult(int iterations);
+static void bench_mat4_look_at(int iterations);
+static void bench_darray_push(int iterations);
+
+static wad bench_wad;
+static const char* bench_mapname;
+static const char* filter;
+static int repetitions;
+static bool has_gl;
+
+static wall_tex* texture_defs;
+static size_t num_texture_defs;
+static const char* lookup_names[4];
+static char patch_name[9];
+static vec2 query_positions[NUM_QUERY_POSITIONS];
+static vec2 walk_positions[NUM_QUERY_POSITIONS];
+static int walk_subsectors[NUM_QUERY_POSITIONS], walk_sectors[NUM_QUERY_POSITIONS];
+
+static bench_result results[16];
+static int num_results;
+
+// Results land here so the compiler cannot drop the work
+static volatile uintptr_t sink;
+static volatile float float_sink;
+
+// bench [-iwad file] [-file pwad] [-map name] [-filter substring] [-reps n] [-threads n] [-o report.json]
+// Every kernel runs on fixed inputs from the WAD: warmup, then -reps samples of enough iterations to
+// last MIN_SAMPLE_SECONDS. Times are per iteration, the JSON report goes to -o, bench.json by default.
+// -threads sizes the pool batched kernels split over, one (no workers) by default
+int main(int argc, char** argv)
+{
+	args_init(argc, argv);
+
+	const char* wad_path = args_get("-iwad") != NULL ? args_get("-iwad") : "res/doom1.wad";
+	bench_mapname = args_get("-map") != NULL ? args_get("-map") : "E1M1";
+	filter = args_get("-filter");
+	repetitions = args_get("-reps") != NULL ? atoi(args_get("-reps")) : DEFAULT_REPETITIONS;
+	if (repetitions <= 0)
+		repetitions = DEFAULT_REPETITIONS;
+	thread_pool_init(args_get("-threads") != NULL ? atoi(args_get("-threads")) : 1);
+
+	if (wad_load_from_file(wad_path, &bench_wad) != 0)
+	{
+		fprintf(stderr, "Failed to load WAD file '%s'\n", wad_path);
+		return -1;
+	}
+	if (args_get("-file") != NULL && wad_add_file(args_get("-file"), &bench_wad) != 0)
+	{
+		fprintf(stderr, "Failed to load PWAD file '%s'\n", args_get("-file"));
+		return -1;
+	}
+
+	texture_defs = wad_read_texture_defs(&num_texture_defs, "TEXTURE1", &bench_wad);
+	if (texture_defs == NULL)
+		num_texture_defs = 0;
+
+	// Front, middle and back of the directory plus a miss
+	lookup_names[0] = bench_wad.lumps[0].name;
+	lookup_names[1] = bench_wad.lumps[bench_wad.num_lumps / 2].name;
+	lookup_names[2] = bench_wad.lumps[bench_wad.num_lumps - 1].name;
+	lookup_names[3] = "NOTALUMP";
+
+	int pnames = wad_find_lump("PNAMES", &bench_wad);
+	if (pnames >= 0 && bench_wad.lumps[pnames].size >= 12)
+		memcpy(patch_name, bench_wad.lumps[pnames].data + 4, 8);
+
+	if (!load_map(bench_mapname))
+		return -1;
+
+	// Mesh generation uploads into buffers, so it needs a context
+	has_gl = headless_context_create() && gladLoadGLLoader(headless_get_proc_address);
+	if (!has_gl)
+		fprintf(stderr, "No OpenGL context, skipping generate_meshes\n");
+
+	run("wad_find_lump", bench_find_lump, 4);
+	if (patch_name[0] != 0)
+		run("wad_read_patch", bench_read_patch, 1);
+	run("wad_read_textures", bench_read_textures, (int)num_texture_defs);
+	run("wad_read_map", bench_read_map, (int)m.num_sidedefs);
+	if (has_gl)
+	{
+		// A kernel that silently drops every flat would time walls only
+		generate_meshes();
+		size_t num_flat_triangles = meshgen_get_stats().num_triangles[SURFACE_FLAT];
+		free_meshes();
+		if (num_flat_triangles == 0)
+		{
+			fprintf(stderr, "generate_meshes emitted no flats on '%s'\n", bench_mapname);
+			return -1;
+		}
+
+		run("generate_meshes", bench_generate_meshes, (int)gl_m.num_subsectors);
+	}
+	run("map_get_sector", bench_map_get_sector, NUM_QUERY_POSITIONS);
+	run("bsp_locate", bench_bsp_locate, NUM_QUERY_POSITIONS);
+	run("bsp_locate_from", bench_bsp_locate_from, NUM_QUERY_POSITIONS);
+	run("bsp_locate_batch", bench_bsp_locate_batch, NUM_QUERY_POSITIONS);
+	run("mat4_mult", bench_mat4_mult, 1);
+	run("mat4_look_at", bench_mat4_look_at, 1);
+	run("darray_push", bench_darray_push, DARRAY_PUSH_COUNT);
+
+	const char* report_path = args_get("-o") != NULL ? args_get("-o") : DEFAULT_REPORT;
+	FILE* file = fopen(report_path, "w");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open '%s'\n", report_path);
+		return -1;
+	}
+	write_report(file);
+	fclose(file);
+	printf("Report written to %s\n", report_path);
+
+	if (has_gl)
+		headless_context_destroy();
+	thread_pool_shutdown();
+	return 0;
+}
+
+void run(const char* name, bench_kernel kernel, int items)
+{
+	if (filter != NULL && strstr(name, filter) == NULL)
+		return;
+
+	int iterations = 1;
+	while (time_sample(kernel, iterations) < MIN_SAMPLE_SECONDS && iterations < (1 << 30))
+		iterations *= 2;
+
+	for (int i = 0; i < WARMUP_REPETITIONS; i++)
+		time_sample(kernel, iterations);
+
+	double* samples = malloc(sizeof(double) * repetitions);
+	double sum = 0.0;
+	for (int i = 0; i < repetitions; i++)
+	{
+		samples[i] = time_sample(kernel, iterations) * 1e9 / iterations;
+		sum += samples[i];
+	}
+	qsort(samples, repetitions, sizeof(double), compare_doubles);
+
+	double mean = sum / repetitions;
+	double variance = 0.0;
+	for (int i = 0; i < repetitions; i++)
+		variance += (samples[i] - mean) * (samples[i] - mean);
+
+	bench_result* result = &results[num_results++];
+	*result = (bench_result){
+		.name = name,
+		.items = items > 0 ? items : 1,
+		.iterations = iterations,
+		.repetitions = repetitions,
+		.min_ns = samples[0],
+		.median_ns = samples[repetitions / 2],
+		.mean_ns = mean,
+		.stddev_ns = repetitions > 1 ? sqrt(variance / (repetitions - 1)) : 0.0
+	};
+	free(samples);
+
+	printf("%-20s %12.1f ns (min %.1f, +-%.1f)\n", name, result->median_ns, result->min_ns, result->stddev_ns);
+}
+
+double time_sample(bench_kernel kernel, int iterations)
+{
+	double start = timer_now();
+	kernel(iterations);
+	return timer_now() - start;
+}
+
+int compare_doubles(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+// Fills the engine globals the map kernels read
+bool load_map(const char* mapname)
+{
+	char gl_mapname[16];
+	snprintf(gl_mapname, sizeof(gl_mapname), "GL_%s", mapname);
+	if (wad_read_gl_map(gl_mapname, &gl_m, &bench_wad) != 0 || wad_read_map(mapname, &m, &bench_wad, texture_defs, (int)num_texture_defs) != 0)
+	{
+		fprintf(stderr, "Failed to read map '%s'\n", mapname);
+		return false;
+	}
+
+	wall_textures_info = malloc(sizeof(wall_tex_info) * (num_texture_defs > 0 ? num_texture_defs : 1));
+	for (size_t i = 0; i < num_texture_defs; i++)
+		wall_textures_info[i] = (wall_tex_info){ texture_defs[i].width, texture_defs[i].height };
+
+	// No residency here, sectors keep their F_START relative flat indices
+	int f_start = wad_find_lump("F_START", &bench_wad);
+	int f_end = wad_find_lump("F_END", &bench_wad);
+	num_flats = f_start >= 0 && f_end > f_start ? f_end - f_start - 1 : 0;
+	sky_flat = f_start >= 0 ? wad_find_lump("F_SKY1", &bench_wad) - f_start - 1 : -1;
+	darray_init(stencil_quads, 0);
+	bsp_build();
+
+	// Fixed seed, the same positions on every run
+	uint32_t seed = 1993;
+	for (int i = 0; i < NUM_QUERY_POSITIONS; i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		float u = (seed >> 8) / 16777216.0f;
+		seed = seed * 1664525u + 1013904223u;
+		float v = (seed >> 8) / 16777216.0f;
+		query_positions[i] = (vec2){ m.min.x + u * (m.max.x - m.min.x), m.min.y + v * (m.max.y - m.min.y) };
+	}
+
+	// A random walk in small steps, like a player or a monster moving tic by tic
+	vec2 position = { (m.min.x + m.max.x) * 0.5f, (m.min.y + m.max.y) * 0.5f };
+	for (int i = 0; i < NUM_QUERY_POSITIONS; i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		float angle = (seed >> 8) / 16777216.0f * 6.28318530718f;
+		position.x = fminf(fmaxf(position.x + cosf(angle) * WALK_STEP, m.min.x), m.max.x);
+		position.y = fminf(fmaxf(position.y + sinf(angle) * WALK_STEP, m.min.y), m.max.y);
+		walk_positions[i] = position;
+	}
+
+	return true;
+}
+
+void write_report(FILE* file)
+{
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"map\": \"%s\",\n", bench_mapname);
+	fprintf(file, "\t\"kernels\": [");
+	for (int i = 0; i < num_results; i++)
+	{
+		const bench_result* result = &results[i];
+		fprintf(file, "%s\n\t\t{\n", i > 0 ? "," : "");
+		fprintf(file, "\t\t\t\"name\": \"%s\",\n", result->name);
+		fprintf(file, "\t\t\t\"iterations\": %d,\n", result->iterations);
+		fprintf(file, "\t\t\t\"repetitions\": %d,\n", result->repetitions);
+		fprintf(file, "\t\t\t\"items\": %d,\n", result->items);
+		fprintf(file, "\t\t\t\"min_ns\": %.3f,\n", result->min_ns);
+		fprintf(file, "\t\t\t\"median_ns\": %.3f,\n", result->median_ns);
+		fprintf(file, "\t\t\t\"mean_ns\": %.3f,\n", result->mean_ns);
+		fprintf(file, "\t\t\t\"stddev_ns\": %.3f,\n", result->stddev_ns);
+		fprintf(file, "\t\t\t\"per_item_ns\": %.3f\n", result->median_ns / result->items);
+		fprintf(file, "\t\t}");
+	}
+	fprintf(file, "\n\t]\n}\n");
+}
+
+void bench_find_lump(int iterations)
+{
+	for (int i = 0; i < iterations; i++)
+	{
+		for (int j = 0; j < 4; j++)
+			sink += wad_find_lump(lookup_names[j], &bench_wad);
+	}
+}
+
+void bench_read_patch(int iterations)
+{
+	for (int i = 0; i < iterations; i++)
+	{
+		patch patch;
+		if (wad_read_patch(&patch, patch_name, &bench_wad) == 0)
+		{
+			sink += patch.data[0];
+			free(patch.data);
+		}
+	}
+}
+
+// Reads every patch and composes all of TEXTURE1
+void bench_read_textures(int iterations)
+{
+	for (int i = 0; i < iterations; i++)
+	{
+		size_t num;
+		wall_tex* textures = wad_read_textures(&num, "TEXTURE1", &bench_wad);
+		if (textures == NULL)
+			continue;
+
+		sink += num;
+		wad_free_wall_textures(textures, num);
+		free(textures);
+	}
+}
+
+// Dominated by read_sidedefs matching texture names against every definition
+void bench_read_map(int iterations)
+{
+	for (int i = 0; i < iterations; i++)
+	{
+		map map;
+		if (wad_read_map(bench_mapname, &map, &bench_wad, texture_defs, (int)num_texture_defs) != 0)
+			continue;
+
+		sink += map.num_sidedefs;
+		wad_free_map(&map);
+	}
+}
+
+// generate_node for every subsector, including the buffer uploads
+void bench_generate_meshes(int iterations)
+{
+	for (int i = 0; i < iterations; i++)
+	{
+		generate_meshes();
+		sink += (uintptr_t)root_draw_node;
+		free_meshes();
+	}
+}
+
+void bench_map_get_sector(int iterations)
+{
+	for (int i = 0; i < iterations; i++)
+	{
+		for (int j = 0; j < NUM_QUERY_POSITIONS; j++)
+			sink += (uintptr_t)map_get_sector(query_positions[j]);
+	}
+}
+
+// The same walk from the root every time, from the last subsector and four lanes at a time
+void bench_bsp_locate(int iterations)
+{
+	for (int i = 0; i < iterations; i++)
+	{
+		for (int j = 0; j < NUM_QUERY_POSITIONS; j++)
+			sink += bsp_locate(walk_positions[j]);
+	}
+}
+
+void bench_bsp_locate_from(int iterations)
+{
+	for (int i = 0; i < iterations; i++)
+	{
+		int subsector = -1;
+		for (int j = 0; j < NUM_QUERY_POSITIONS; j++)
+		{
+			subsector = bsp_locate_from(walk_positions[j], subsector);
+			sink += subsector;
+		}
+	}
+}
+
+void bench_bsp_locate_batch(int iterations)
+{
+	for (int i = 0; i < iterations; i++)
+	{
+		bsp_locate_batch(walk_positions, NUM_QUERY_POSITIONS, walk_subsectors, walk_sectors);
+		sink += walk_sectors[i % NUM_QUERY_POSITIONS];
+	}
+}
+
+void bench_mat4_mult(int iterations)
+{
+	mat4 a = mat4_translate((vec3){ 1.0f, 2.0f, 3.0f });
+	mat4 b = mat4_rotate((vec3){ 0.0f, 1.0f, 0.0f }, 0.5f);
+	for (int i = 0; i < iterations; i++)
+	{
+		a = mat4_mult(a, b);
+		float_sink += a.v[0];
+	}
+}
+
+void bench_mat4_look_at(int iterations)
+{
+	vec3 up = { 0.0f, 1.0f, 0.0f };
+	for (int i = 0; i < iterations; i++)
+	{
+		vec3 eye = { (float)(i & 255), 41.0f, 7.0f };
+		mat4 view = mat4_look_at(eye, (vec3){ 0.0f, 0.0f, 0.0f }, up);
+		float_sink += view.v[12];
+	}
+}
+
+// Growth from empty, including every reallocation
+void bench_darray_push(int iterations)
+{
+	for (int i = 0; i < iterations; i++)
+	{
+		darray(uint32_t) array;
+		darray_init(array, 0);
+		for (uint32_t j = 0; j < DARRAY_PUSH_COUNT; j++)
+			darray_push(array, j);
+
+		sink += array.data[DARRAY_PUSH_COUNT - 1];
+		darray_free(array);
+	}
+}
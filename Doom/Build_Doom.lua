@@ -29,8 +29,7 @@ project "Doom"
 
     links
     {
-        "Glad",
-        "glfw3.lib"
+        "Glad"
     }
 
     targetdir ("%{wks.location}/bin/" .. outputdir .. "/%{prj.name}")
@@ -38,6 +37,12 @@ project "Doom"
 
     filter "system:windows"
         systemversion "latest"
+        links { "glfw3.lib" }
+
+    -- The bundled glfw3.lib is Windows only, Linux uses the system GLFW (libglfw3-dev).
+    -- X11 is for -software, which presents through XPutImage instead of a GL context
+    filter "system:linux"
+        links { "glfw", "pthread", "EGL", "X11", "m" }
 
     filter "configurations:Debug"
         defines { "DEBUG" }
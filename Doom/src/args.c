@@ -0,0 +1,38 @@
+#include "args.h"
+#include "utils.h"
+
+#include <stddef.h>
+
+static int num_args;
+static char** args;
+
+void args_init(int argc, char** argv)
+{
+	num_args = argc;
+	args = argv;
+}
+
+int args_check(const char* flag)
+{
+	for (int i = 1; i < num_args; i++)
+	{
+		if (strcmp_nocase(args[i], flag) == 0)
+			return i;
+	}
+
+	return 0;
+}
+
+bool args_has(const char* flag)
+{
+	return args_check(flag) != 0;
+}
+
+const char* args_get(const char* flag)
+{
+	int index = args_check(flag);
+	if (index == 0 || index + 1 >= num_args)
+		return NULL;
+
+	return args[index + 1];
+}
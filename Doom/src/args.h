@@ -0,0 +1,11 @@
+#pragma once
+#include <stdbool.h>
+
+// Doom-style command line, flags look like -truecolor or -iwad doom2.wad
+void args_init(int argc, char** argv);
+
+// Position of the flag in argv, 0 when it is not present
+int args_check(const char* flag);
+bool args_has(const char* flag);
+// The argument following the flag, NULL when either is missing
+const char* args_get(const char* flag);
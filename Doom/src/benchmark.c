@@ -0,0 +1,297 @@
+#include "benchmark.h"
+#include "args.h"
+#include "render_queue.h"
+#include "timer.h"
+#include "engine/engine.h"
+#include "engine/state.h"
+#include "software/software_renderer.h"
+
+#include "glad/glad.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct map_result
+{
+	char name[9];
+	bool is_loaded;
+	double load_ms;
+	double* frame_ms;
+	int num_frames;
+	double draws, triangles; // Sums over all frames
+} map_result;
+
+static bool is_map_name(const char* name);
+static void build_tour();
+static vec2 subsector_centroid(const gl_subsector* subsector);
+static void write_report();
+static double percentile(const double* sorted, int count, double p);
+static int compare_doubles(const void* a, const void* b);
+static void finish_gpu();
+
+static bool is_enabled;
+static const char* report_path;
+static int frames_per_map;
+static int output_width, output_height;
+
+static map_result* results;
+static int num_maps;
+static int current_map = -1;
+static int current_frame;
+static double frame_start;
+
+static vec2 waypoints[BENCHMARK_MAX_WAYPOINTS];
+static int num_waypoints;
+static float last_yaw;
+
+void benchmark_init(const wad* wad, int width, int height)
+{
+	report_path = args_get("-benchmark");
+	is_enabled = report_path != NULL;
+	if (!is_enabled)
+		return;
+
+	output_width = width;
+	output_height = height;
+	frames_per_map = args_get("-frames") != NULL ? atoi(args_get("-frames")) : BENCHMARK_DEFAULT_FRAMES;
+	if (frames_per_map <= 0)
+		frames_per_map = BENCHMARK_DEFAULT_FRAMES;
+
+	results = malloc(sizeof(map_result) * (wad->num_lumps > 0 ? wad->num_lumps : 1));
+	num_maps = 0;
+	for (uint32_t i = 0; i < wad->num_lumps; i++)
+	{
+		const char* name = wad->lumps[i].name;
+		// Maps replaced by a PWAD only count once
+		if (!is_map_name(name) || wad_find_lump(name, wad) != (int)i)
+			continue;
+
+		// Only maps the engine can draw, which needs their GL nodes
+		char gl_name[9];
+		snprintf(gl_name, sizeof(gl_name), "GL_%s", name);
+		if (wad_find_lump(gl_name, wad) < 0)
+			continue;
+
+		map_result* result = &results[num_maps++];
+		*result = (map_result){ 0 };
+		strcpy(result->name, name);
+		result->frame_ms = malloc(sizeof(double) * frames_per_map);
+	}
+
+	printf("Benchmark: %d maps, %d frames each\n", num_maps, frames_per_map);
+}
+
+bool benchmark_is_enabled()
+{
+	return is_enabled;
+}
+
+bool benchmark_begin_frame()
+{
+	if (current_map < 0 || current_frame >= frames_per_map)
+	{
+		current_map++;
+		current_frame = 0;
+
+		// Skip maps that fail to load, they keep no frames
+		while (current_map < num_maps)
+		{
+			map_result* result = &results[current_map];
+			double start = timer_now();
+			result->is_loaded = engine_load_map(result->name);
+			finish_gpu();
+			result->load_ms = (timer_now() - start) * 1000.0;
+
+			if (result->is_loaded)
+				break;
+			current_map++;
+		}
+
+		if (current_map >= num_maps)
+			return false;
+
+		build_tour();
+	}
+
+	// Constant speed along the polyline through the waypoints, facing the way it goes
+	float t = (float)current_frame / frames_per_map * (num_waypoints - 1);
+	int segment = (int)t;
+	if (segment >= num_waypoints - 1)
+		segment = num_waypoints - 2;
+
+	vec2 position = waypoints[0];
+	float yaw = last_yaw;
+	if (num_waypoints > 1)
+	{
+		vec2 from = waypoints[segment];
+		vec2 to = waypoints[segment + 1];
+		float s = t - segment;
+		position = (vec2){ from.x + (to.x - from.x) * s, from.y + (to.y - from.y) * s };
+		if (to.x != from.x || to.y != from.y)
+			yaw = atan2f(to.y - from.y, to.x - from.x);
+	}
+	else
+	{
+		yaw = 6.28318530718f * current_frame / frames_per_map;
+	}
+	last_yaw = yaw;
+
+	engine_set_view(position, yaw, 0.0f);
+	// An idle tic keeps the animations going
+	ticcmd idle = { 0 };
+	engine_run_tic(&idle);
+
+	frame_start = timer_now();
+	return true;
+}
+
+void benchmark_end_frame()
+{
+	if (!is_enabled || current_map < 0 || current_map >= num_maps)
+		return;
+
+	finish_gpu();
+	map_result* result = &results[current_map];
+	result->frame_ms[current_frame] = (timer_now() - frame_start) * 1000.0;
+	result->num_frames = ++current_frame;
+
+	if (!software_renderer_is_enabled())
+	{
+		render_stats stats = render_queue_get_stats();
+		result->draws += stats.num_draws;
+		result->triangles += stats.num_triangles;
+	}
+}
+
+void benchmark_shutdown()
+{
+	if (!is_enabled)
+		return;
+
+	write_report();
+
+	for (int i = 0; i < num_maps; i++)
+		free(results[i].frame_ms);
+	free(results);
+	is_enabled = false;
+}
+
+// ExMy and MAPxx
+bool is_map_name(const char* name)
+{
+	if (strlen(name) == 4 && toupper(name[0]) == 'E' && isdigit(name[1]) && toupper(name[2]) == 'M' && isdigit(name[3]))
+		return true;
+
+	return strlen(name) == 5 && strncmp(name, "MAP", 3) == 0 && isdigit(name[3]) && isdigit(name[4]);
+}
+
+// Evenly spaced subsectors in BSP order, neighbours in the list are mostly neighbours on the map
+void build_tour()
+{
+	size_t num_subsectors = gl_m.num_subsectors;
+	num_waypoints = 0;
+	for (size_t i = 0; i < num_subsectors && num_waypoints < BENCHMARK_MAX_WAYPOINTS; i++)
+	{
+		size_t index = num_subsectors <= BENCHMARK_MAX_WAYPOINTS ? i : i * num_subsectors / BENCHMARK_MAX_WAYPOINTS;
+		const gl_subsector* subsector = &gl_m.subsectors[index];
+		if (subsector->num_segs == 0)
+			continue;
+
+		waypoints[num_waypoints++] = subsector_centroid(subsector);
+	}
+
+	if (num_waypoints == 0)
+		waypoints[num_waypoints++] = (vec2){ (m.min.x + m.max.x) * 0.5f, (m.min.y + m.max.y) * 0.5f };
+	last_yaw = 0.0f;
+}
+
+vec2 subsector_centroid(const gl_subsector* subsector)
+{
+	vec2 sum = { 0.0f, 0.0f };
+	for (int i = 0; i < subsector->num_segs; i++)
+	{
+		uint16_t start = gl_m.segments[subsector->first_seg + i].start_vertex;
+		vec2 vertex = (start & VERT_IS_GL) ? gl_m.vertices[start & 0x7fff] : m.vertices[start];
+		sum.x += vertex.x;
+		sum.y += vertex.y;
+	}
+
+	return (vec2){ sum.x / subsector->num_segs, sum.y / subsector->num_segs };
+}
+
+void write_report()
+{
+	FILE* file = fopen(report_path, "w");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open benchmark report '%s'\n", report_path);
+		return;
+	}
+
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"renderer\": \"%s\",\n", software_renderer_is_enabled() ? "software" : "opengl");
+	fprintf(file, "\t\"device\": \"%s\",\n", software_renderer_is_enabled() ? "cpu" : (const char*)glGetString(GL_RENDERER));
+	fprintf(file, "\t\"frames_per_map\": %d,\n", frames_per_map);
+	fprintf(file, "\t\"maps\": [");
+
+	double* sorted = malloc(sizeof(double) * frames_per_map);
+	double total_ms = 0.0;
+	int total_frames = 0;
+	for (int i = 0; i < num_maps; i++)
+	{
+		const map_result* result = &results[i];
+		fprintf(file, "%s\n\t\t{\n\t\t\t\"name\": \"%s\",\n\t\t\t\"loaded\": %s,\n\t\t\t\"load_ms\": %.3f,\n\t\t\t\"frames\": %d",
+			i > 0 ? "," : "", result->name, result->is_loaded ? "true" : "false", result->load_ms, result->num_frames);
+
+		int n = result->num_frames;
+		if (n > 0)
+		{
+			double sum = 0.0;
+			for (int j = 0; j < n; j++)
+				sum += result->frame_ms[j];
+			memcpy(sorted, result->frame_ms, sizeof(double) * n);
+			qsort(sorted, n, sizeof(double), compare_doubles);
+
+			fprintf(file, ",\n\t\t\t\"avg_ms\": %.3f,\n\t\t\t\"p50_ms\": %.3f,\n\t\t\t\"p95_ms\": %.3f,\n\t\t\t\"p99_ms\": %.3f",
+				sum / n, percentile(sorted, n, 0.50), percentile(sorted, n, 0.95), percentile(sorted, n, 0.99));
+			fprintf(file, ",\n\t\t\t\"draws\": %.1f,\n\t\t\t\"triangles\": %.1f", result->draws / n, result->triangles / n);
+
+			printf("Benchmark: %-5s load %7.2f ms, avg %6.3f ms, p99 %6.3f ms\n", result->name, result->load_ms, sum / n, percentile(sorted, n, 0.99));
+			total_ms += sum;
+			total_frames += n;
+		}
+
+		fprintf(file, "\n\t\t}");
+	}
+	free(sorted);
+
+	fprintf(file, "\n\t],\n");
+	fprintf(file, "\t\"width\": %d,\n\t\"height\": %d,\n", output_width, output_height);
+	fprintf(file, "\t\"avg_ms\": %.3f\n}\n", total_frames > 0 ? total_ms / total_frames : 0.0);
+	fclose(file);
+
+	printf("Benchmark: report written to %s\n", report_path);
+}
+
+// Nearest rank
+double percentile(const double* sorted, int count, double p)
+{
+	int rank = (int)ceil(p * count) - 1;
+	return sorted[rank < 0 ? 0 : rank >= count ? count - 1 : rank];
+}
+
+int compare_doubles(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+// The software renderer is done when software_renderer_draw returns and has no context to wait on
+void finish_gpu()
+{
+	if (!software_renderer_is_enabled())
+		glFinish();
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "wad_loader.h"
+
+#include <stdbool.h>
+
+#define BENCHMARK_DEFAULT_FRAMES 300	// Frames drawn on every map unless -frames says otherwise
+#define BENCHMARK_MAX_WAYPOINTS 64	// Subsector centroids the camera tours on one map
+
+// Set with -benchmark <report.json>. Every map that has GL nodes is loaded in turn and the camera
+// flies through subsector centroids, in BSP order, for -frames frames. Each frame is finished on
+// the GPU before it is timed so the numbers compare between builds. The JSON report holds the load
+// time, average, p50, p95 and p99 frame times, draws and triangles of every map
+void benchmark_init(const wad* wad, int width, int height);
+bool benchmark_is_enabled();
+
+// Loads the next map once the current one has had its frames and places the camera, false when
+// every map is done
+bool benchmark_begin_frame();
+// Call after drawing, before capturing or swapping
+void benchmark_end_frame();
+
+// Writes the report
+void benchmark_shutdown();
@@ -0,0 +1,457 @@
+#include "capture.h"
+#include "args.h"
+#include "render_target.h"
+#include "thread.h"
+#include "utils.h"
+#include "software/software_renderer.h"
+
+#include "glad/glad.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct readback
+{
+	GLuint pbo;
+	GLsync fence;
+	int frame;
+} readback;
+
+typedef struct capture_job
+{
+	uint8_t* pixels;	// Bottom-up RGBA8, as GL reads it and the software renderer writes it
+	int frame;
+} capture_job;
+
+static int capture_main(void* data);
+static void collect(readback* slot, bool can_wait);
+static void enqueue(uint8_t* pixels, int frame);
+static void free_resources();
+static void write_png(const char* filename, const uint8_t* pixels);
+static void write_chunk(FILE* file, const char* type, const uint8_t* data, size_t size);
+static void write_be32(FILE* file, uint32_t value);
+static uint32_t crc_update(uint32_t crc, const uint8_t* data, size_t size);
+static void write_y4m_frame(FILE* file, const uint8_t* planes);
+static void convert_y4m_frame(const uint8_t* pixels, uint8_t* planes);
+
+static bool is_enabled;
+static bool is_y4m;
+static const char* path;
+static int width, height;
+static size_t frame_size;
+static size_t y4m_frame_size;
+
+static readback ring[CAPTURE_LATENCY];
+static int next_slot;
+static int num_frames;
+static int num_dropped;
+
+// Writer thread state, guarded by mutex
+static thread* writer;
+static thread_mutex* mutex;
+static thread_cond* queue_cond;
+static capture_job queue[CAPTURE_QUEUE_SIZE];
+static int queue_head, queue_count;
+static bool is_stopping;
+static int num_written;
+
+static uint32_t crc_table[256];
+
+void capture_init(int w, int h)
+{
+	path = args_get("-capture");
+	is_enabled = path != NULL;
+	if (!is_enabled)
+		return;
+
+	width = w;
+	height = h;
+	frame_size = (size_t)width * height * 4;
+	size_t length = strlen(path);
+	is_y4m = length > 4 && strcmp(path + length - 4, ".y4m") == 0;
+	y4m_frame_size = (size_t)width * height + (size_t)((width + 1) / 2) * ((height + 1) / 2) * 2;
+
+	// Software frames are already in memory and need no readback
+	for (int i = 0; i < CAPTURE_LATENCY && !software_renderer_is_enabled(); i++)
+	{
+		glGenBuffers(1, &ring[i].pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, ring[i].pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, frame_size, NULL, GL_STREAM_READ);
+		ring[i].fence = NULL;
+	}
+	if (!software_renderer_is_enabled())
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	mutex = thread_mutex_create();
+	queue_cond = thread_cond_create();
+	writer = thread_create(capture_main, NULL);
+	if (writer == NULL)
+	{
+		fprintf(stderr, "Failed to start the capture writer\n");
+		free_resources();
+		is_enabled = false;
+		return;
+	}
+
+	printf("Capturing %dx%d to %s%s\n", width, height, path, is_y4m ? "" : "_*.png");
+}
+
+bool capture_is_enabled()
+{
+	return is_enabled;
+}
+
+void capture_frame()
+{
+	if (!is_enabled)
+		return;
+
+	if (software_renderer_is_enabled())
+	{
+		uint8_t* pixels = malloc(frame_size);
+		memcpy(pixels, software_renderer_get_pixels(), frame_size);
+		enqueue(pixels, num_frames++);
+		return;
+	}
+
+	// The slot about to be reused holds the readback from CAPTURE_LATENCY frames ago
+	readback* slot = &ring[next_slot];
+	next_slot = (next_slot + 1) % CAPTURE_LATENCY;
+
+	if (slot->fence != NULL)
+	{
+		collect(slot, false);
+		if (slot->fence != NULL)
+		{
+			// Still not done on the GPU, drop this frame rather than stall on it
+			num_dropped++;
+			num_frames++;
+			return;
+		}
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, render_target_get_default());
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot->frame = num_frames++;
+}
+
+void capture_shutdown()
+{
+	if (!is_enabled)
+		return;
+
+	// Oldest first so the writer still sees frames in order
+	for (int i = 0; i < CAPTURE_LATENCY; i++)
+	{
+		readback* slot = &ring[(next_slot + i) % CAPTURE_LATENCY];
+		if (slot->fence != NULL)
+			collect(slot, true);
+	}
+
+	thread_mutex_lock(mutex);
+	is_stopping = true;
+	thread_cond_broadcast(queue_cond);
+	thread_mutex_unlock(mutex);
+	thread_join(writer);
+	free_resources();
+
+	printf("Capture: %d frames written, %d dropped%s\n", num_written, num_dropped,
+		is_y4m && num_dropped > 0 ? " (repeated in the video to keep its timing)" : "");
+	is_enabled = false;
+}
+
+void free_resources()
+{
+	for (int i = 0; i < CAPTURE_LATENCY && !software_renderer_is_enabled(); i++)
+		glDeleteBuffers(1, &ring[i].pbo);
+	thread_cond_destroy(queue_cond);
+	thread_mutex_destroy(mutex);
+}
+
+// Hands a finished readback to the writer, or leaves it pending when the GPU is not done yet
+void collect(readback* slot, bool can_wait)
+{
+	GLbitfield flags = can_wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0;
+	GLuint64 timeout = can_wait ? UINT64_MAX : 0;
+	GLenum status = glClientWaitSync(slot->fence, flags, timeout);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		return;
+
+	glDeleteSync(slot->fence);
+	slot->fence = NULL;
+
+	uint8_t* pixels = malloc(frame_size);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+	const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame_size, GL_MAP_READ_BIT);
+	if (mapped != NULL)
+	{
+		memcpy(pixels, mapped, frame_size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if (mapped == NULL)
+	{
+		free(pixels);
+		num_dropped++;
+		return;
+	}
+
+	enqueue(pixels, slot->frame);
+}
+
+// Hands pixels to the writer, which frees them, or drops the frame when the queue is full
+void enqueue(uint8_t* pixels, int frame)
+{
+	thread_mutex_lock(mutex);
+	bool is_full = queue_count == CAPTURE_QUEUE_SIZE;
+	if (!is_full)
+	{
+		queue[(queue_head + queue_count) % CAPTURE_QUEUE_SIZE] = (capture_job){ pixels, frame };
+		queue_count++;
+		thread_cond_signal(queue_cond);
+	}
+	thread_mutex_unlock(mutex);
+
+	if (is_full)
+	{
+		free(pixels);
+		num_dropped++;
+	}
+}
+
+int capture_main(void* data)
+{
+	FILE* y4m = NULL;
+	uint8_t* planes = NULL;
+	int next_y4m_frame = 0; // Index the next FRAME written to the video stands for
+	if (is_y4m)
+	{
+		y4m = fopen(path, "wb");
+		if (y4m == NULL)
+			fprintf(stderr, "Failed to open '%s' for capture\n", path);
+		else
+			fprintf(y4m, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, CAPTURE_FPS);
+	}
+
+	char filename[1024];
+	thread_mutex_lock(mutex);
+	while (true)
+	{
+		while (queue_count == 0 && !is_stopping)
+			thread_cond_wait(queue_cond, mutex);
+
+		if (queue_count == 0)
+			break;
+
+		capture_job job = queue[queue_head];
+		thread_mutex_unlock(mutex);
+
+		if (y4m != NULL)
+		{
+			// A fixed frame rate stream has no timestamps, dropped frames repeat the last one so
+			// the video keeps the length and timing of the run
+			for (; planes != NULL && next_y4m_frame < job.frame; next_y4m_frame++)
+				write_y4m_frame(y4m, planes);
+
+			if (planes == NULL)
+				planes = malloc(y4m_frame_size);
+			convert_y4m_frame(job.pixels, planes);
+			for (; next_y4m_frame <= job.frame; next_y4m_frame++)
+				write_y4m_frame(y4m, planes);
+		}
+		else if (!is_y4m)
+		{
+			snprintf(filename, sizeof(filename), "%s_%06d.png", path, job.frame);
+			write_png(filename, job.pixels);
+		}
+		free(job.pixels);
+
+		// The slot is only released once written so the queue bounds memory too
+		thread_mutex_lock(mutex);
+		queue_head = (queue_head + 1) % CAPTURE_QUEUE_SIZE;
+		queue_count--;
+		num_written++;
+	}
+	thread_mutex_unlock(mutex);
+
+	if (y4m != NULL)
+	{
+		// Frames dropped at the very end, num_frames no longer changes once stopping
+		for (; planes != NULL && next_y4m_frame < num_frames; next_y4m_frame++)
+			write_y4m_frame(y4m, planes);
+		fclose(y4m);
+	}
+	free(planes);
+
+	return 0;
+}
+
+void write_be32(FILE* file, uint32_t value)
+{
+	uint8_t bytes[4] = { value >> 24, value >> 16, value >> 8, value };
+	fwrite(bytes, 1, 4, file);
+}
+
+uint32_t crc_update(uint32_t crc, const uint8_t* data, size_t size)
+{
+	if (crc_table[1] == 0)
+	{
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			crc_table[i] = c;
+		}
+	}
+
+	for (size_t i = 0; i < size; i++)
+		crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+void write_chunk(FILE* file, const char* type, const uint8_t* data, size_t size)
+{
+	write_be32(file, (uint32_t)size);
+	fwrite(type, 1, 4, file);
+	if (size > 0)
+		fwrite(data, 1, size, file);
+
+	uint32_t crc = crc_update(0xffffffffu, (const uint8_t*)type, 4);
+	crc = crc_update(crc, data, size);
+	write_be32(file, crc ^ 0xffffffffu);
+}
+
+// RGB PNG wrapped in stored (uncompressed) deflate blocks, cheap enough to keep up with capture
+void write_png(const char* filename, const uint8_t* pixels)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open '%s' for capture\n", filename);
+		return;
+	}
+
+	size_t row_size = (size_t)width * 3 + 1;
+	size_t raw_size = row_size * height;
+	size_t num_blocks = (raw_size + 0xffff - 1) / 0xffff;
+	size_t zlib_size = 2 + raw_size + num_blocks * 5 + 4;
+	uint8_t* zlib = malloc(zlib_size);
+
+	// Rows go top-down with filter 0, GL's are bottom-up
+	uint8_t* raw = malloc(raw_size);
+	for (int y = 0; y < height; y++)
+	{
+		uint8_t* row = raw + y * row_size;
+		const uint8_t* src = pixels + (size_t)(height - 1 - y) * width * 4;
+		row[0] = 0;
+		for (int x = 0; x < width; x++)
+		{
+			row[1 + x * 3 + 0] = src[x * 4 + 0];
+			row[1 + x * 3 + 1] = src[x * 4 + 1];
+			row[1 + x * 3 + 2] = src[x * 4 + 2];
+		}
+	}
+
+	size_t out = 0;
+	zlib[out++] = 0x78;
+	zlib[out++] = 0x01;
+	uint32_t a = 1, b = 0;
+	for (size_t offset = 0; offset < raw_size; offset += 0xffff)
+	{
+		size_t size = raw_size - offset < 0xffff ? raw_size - offset : 0xffff;
+		zlib[out++] = offset + size == raw_size ? 1 : 0;
+		zlib[out++] = size & 0xff;
+		zlib[out++] = size >> 8;
+		zlib[out++] = ~size & 0xff;
+		zlib[out++] = (~size >> 8) & 0xff;
+		memcpy(zlib + out, raw + offset, size);
+		out += size;
+
+		for (size_t i = 0; i < size; i++)
+		{
+			a = (a + raw[offset + i]) % 65521;
+			b = (b + a) % 65521;
+		}
+	}
+	uint32_t adler = (b << 16) | a;
+	zlib[out++] = adler >> 24;
+	zlib[out++] = adler >> 16;
+	zlib[out++] = adler >> 8;
+	zlib[out++] = adler;
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	uint8_t header[13] = {
+		width >> 24, width >> 16, width >> 8, width,
+		height >> 24, height >> 16, height >> 8, height,
+		8, 2, 0, 0, 0 // 8-bit RGB, no interlacing
+	};
+
+	fwrite(signature, 1, 8, file);
+	write_chunk(file, "IHDR", header, sizeof(header));
+	write_chunk(file, "IDAT", zlib, out);
+	write_chunk(file, "IEND", NULL, 0);
+	fclose(file);
+
+	free(raw);
+	free(zlib);
+}
+
+void write_y4m_frame(FILE* file, const uint8_t* planes)
+{
+	fputs("FRAME\n", file);
+	fwrite(planes, 1, y4m_frame_size, file);
+}
+
+// Full range BT.601 4:2:0 (C420jpeg), chroma from the average of each 2x2 block
+void convert_y4m_frame(const uint8_t* pixels, uint8_t* planes)
+{
+	int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+	size_t luma_size = (size_t)width * height;
+	size_t chroma_size = (size_t)chroma_width * chroma_height;
+	uint8_t* y_plane = planes;
+	uint8_t* u_plane = planes + luma_size;
+	uint8_t* v_plane = u_plane + chroma_size;
+
+	for (int y = 0; y < height; y++)
+	{
+		const uint8_t* src = pixels + (size_t)(height - 1 - y) * width * 4;
+		for (int x = 0; x < width; x++)
+		{
+			int r = src[x * 4], g = src[x * 4 + 1], b = src[x * 4 + 2];
+			y_plane[(size_t)y * width + x] = (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+		}
+	}
+
+	for (int cy = 0; cy < chroma_height; cy++)
+	{
+		for (int cx = 0; cx < chroma_width; cx++)
+		{
+			int r = 0, g = 0, b = 0, n = 0;
+			for (int dy = 0; dy < 2; dy++)
+			{
+				int y = min(cy * 2 + dy, height - 1);
+				const uint8_t* src = pixels + (size_t)(height - 1 - y) * width * 4;
+				for (int dx = 0; dx < 2; dx++)
+				{
+					int x = min(cx * 2 + dx, width - 1);
+					r += src[x * 4], g += src[x * 4 + 1], b += src[x * 4 + 2];
+					n++;
+				}
+			}
+			r /= n, g /= n, b /= n;
+
+			size_t i = (size_t)cy * chroma_width + cx;
+			u_plane[i] = (uint8_t)min(max((-43 * r - 85 * g + 128 * b + 128) / 256 + 128, 0), 255);
+			v_plane[i] = (uint8_t)min(max((128 * r - 107 * g - 21 * b + 128) / 256 + 128, 0), 255);
+		}
+	}
+}
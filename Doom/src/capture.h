@@ -0,0 +1,21 @@
+#pragma once
+#include <stdbool.h>
+
+#define CAPTURE_LATENCY 3	// Frames between a readback being queued and its pixels being collected
+#define CAPTURE_QUEUE_SIZE 8	// Frames waiting for the writer thread
+#define CAPTURE_FPS 60		// Frame rate written into Y4M headers
+
+// Set with -capture <path>. A path ending in .y4m records one raw 4:2:0 stream, anything else is
+// used as a prefix for numbered PNGs (path_000000.png). Readbacks go into a ring of pixel pack
+// buffers and are collected CAPTURE_LATENCY frames later once their fence has signalled, the
+// pixels are then encoded by a writer thread. When either stage falls behind frames are dropped,
+// the frame loop never waits
+void capture_init(int width, int height);
+bool capture_is_enabled();
+
+// Queues a readback of the frame in the default framebuffer, or a copy of the software renderer's
+// frame, call after drawing and before swapping
+void capture_frame();
+
+// Waits for everything still in flight, then prints how many frames were written and dropped
+void capture_shutdown();
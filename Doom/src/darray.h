@@ -21,9 +21,9 @@
 
 #define darray_free(array)                                                     \
   do {                                                                         \
+    if (array.capacity > 0) free(array.data);                                  \
     array.count = 0;                                                           \
     array.capacity = 0;                                                        \
-    if (array.capacity > 0) free(array.data);                                  \
   } while (0)
 
 #define darray_push(array, value)                                              \
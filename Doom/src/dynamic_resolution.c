@@ -0,0 +1,88 @@
+#include "dynamic_resolution.h"
+#include "glad/glad.h"
+
+#include <math.h>
+
+// Only react to errors beyond this fraction of the budget, and close the gap gradually
+#define DEADBAND 0.05f
+#define DAMPING 0.25f
+
+static GLuint queries[DYNAMIC_RESOLUTION_QUERIES];
+static bool is_pending[DYNAMIC_RESOLUTION_QUERIES];
+static int query_index;
+static bool is_timing;
+
+static float budget;
+static float scale;
+static float gpu_ms;
+
+static void update_scale(float frame_ms);
+
+void dynamic_resolution_init(float budget_ms)
+{
+	budget = budget_ms;
+	scale = 1.0f;
+	gpu_ms = 0.0f;
+
+	glGenQueries(DYNAMIC_RESOLUTION_QUERIES, queries);
+	for (int i = 0; i < DYNAMIC_RESOLUTION_QUERIES; i++)
+		is_pending[i] = false;
+	query_index = 0;
+}
+
+void dynamic_resolution_begin_frame()
+{
+	// The oldest query is reused once its result has landed. Until then this frame goes untimed
+	// rather than waiting for it
+	GLuint query = queries[query_index];
+	if (is_pending[query_index])
+	{
+		GLuint is_available = GL_FALSE;
+		glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &is_available);
+		if (!is_available)
+		{
+			is_timing = false;
+			return;
+		}
+
+		GLuint64 elapsed;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+		is_pending[query_index] = false;
+		update_scale(elapsed / 1000000.0f);
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, query);
+	is_timing = true;
+}
+
+void dynamic_resolution_end_frame()
+{
+	if (!is_timing)
+		return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	is_pending[query_index] = true;
+	query_index = (query_index + 1) % DYNAMIC_RESOLUTION_QUERIES;
+}
+
+float dynamic_resolution_get_scale()
+{
+	return scale;
+}
+
+float dynamic_resolution_get_gpu_ms()
+{
+	return gpu_ms;
+}
+
+void update_scale(float frame_ms)
+{
+	gpu_ms = frame_ms;
+	if (frame_ms <= 0.0f || fabsf(frame_ms - budget) < budget * DEADBAND)
+		return;
+
+	// Cost is roughly proportional to the pixel count, i.e. to scale squared
+	float target = scale * sqrtf(budget / frame_ms);
+	scale += (target - scale) * DAMPING;
+	scale = fminf(fmaxf(scale, DYNAMIC_RESOLUTION_MIN_SCALE), 1.0f);
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <stdbool.h>
+
+#define DYNAMIC_RESOLUTION_MIN_SCALE 0.5f
+#define DYNAMIC_RESOLUTION_QUERIES 4
+
+// Scales the internal resolution so the GPU time of a frame stays within budget_ms. Frame
+// times come from GL_TIME_ELAPSED queries kept in a small ring, so reading them never stalls
+void dynamic_resolution_init(float budget_ms);
+
+// Bracket the GPU work that should count against the budget
+void dynamic_resolution_begin_frame();
+void dynamic_resolution_end_frame();
+
+// Linear scale applied to both axes, in [DYNAMIC_RESOLUTION_MIN_SCALE, 1]
+float dynamic_resolution_get_scale();
+float dynamic_resolution_get_gpu_ms();
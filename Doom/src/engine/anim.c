@@ -1,42 +1,263 @@
 #include "engine/anim.h"
-#include "mesh.h"
+#include "stream_buffer.h"
+#include "utils.h"
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-flat_anim_t* flat_anim = NULL, ** flat_anim_ptr = &flat_anim;
+typedef struct anim_table
+{
+    size_t num;
+    int32_t* translation;
+    GLuint texture;
+} anim_table;
+
+static tex_anim_def tex_anim_defs[] = {
+    {false, "NUKAGE3",  "NUKAGE1"},
+    {false, "FWATER4",  "FWATER1"},
+    {false, "SWATER4",  "SWATER1"},
+    {false, "LAVA4",    "LAVA1"},
+    {false, "BLOOD3",   "BLOOD1"},
+    {false, "RROCK08",  "RROCK05"},
+    {false, "SLIME04",  "SLIME01"},
+    {false, "SLIME08",  "SLIME05"},
+    {false, "SLIME12",  "SLIME09"},
+
+    {true,  "BLODGR4",  "BLODGR1"},
+    {true,  "SLADRIP3", "SLADRIP1"},
+    {true,  "BLODRIP4", "BLODRIP1"},
+    {true,  "FIREWALL", "FIREWALA"},
+    {true,  "GSTFONT3", "GSTFONT1"},
+    {true,  "FIRELAVA", "FIRELAV3"},
+    {true,  "FIREMAG3", "FIREMAG1"},
+    {true,  "FIREBLU2", "FIREBLU1"},
+    {true,  "ROCKRED3", "ROCKRED1"},
+    {true,  "BFALL4",   "BFALL1"},
+    {true,  "SFALL4",   "SFALL1"},
+    {true,  "WFALL4",   "WFALL1"},
+    {true,  "DBRAIN4",  "DBRAIN1"},
+};
+
+static switch_def switch_defs[] = {
+    {"SW1BRCOM", "SW2BRCOM"}, {"SW1BRN1",  "SW2BRN1"},  {"SW1BRN2",  "SW2BRN2"},
+    {"SW1BRNGN", "SW2BRNGN"}, {"SW1BROWN", "SW2BROWN"}, {"SW1COMM",  "SW2COMM"},
+    {"SW1COMP",  "SW2COMP"},  {"SW1DIRT",  "SW2DIRT"},  {"SW1EXIT",  "SW2EXIT"},
+    {"SW1GRAY",  "SW2GRAY"},  {"SW1GRAY1", "SW2GRAY1"}, {"SW1METAL", "SW2METAL"},
+    {"SW1PIPE",  "SW2PIPE"},  {"SW1SLAD",  "SW2SLAD"},  {"SW1STARG", "SW2STARG"},
+    {"SW1STON1", "SW2STON1"}, {"SW1STON2", "SW2STON2"}, {"SW1STONE", "SW2STONE"},
+    {"SW1STRTN", "SW2STRTN"}, {"SW1BLUE",  "SW2BLUE"},  {"SW1CMT",   "SW2CMT"},
+    {"SW1GARG",  "SW2GARG"},  {"SW1GSTON", "SW2GSTON"}, {"SW1HOT",   "SW2HOT"},
+    {"SW1LION",  "SW2LION"},  {"SW1SATYR", "SW2SATYR"}, {"SW1SKIN",  "SW2SKIN"},
+    {"SW1VINE",  "SW2VINE"},  {"SW1WOOD",  "SW2WOOD"},  {"SW1PANEL", "SW2PANEL"},
+    {"SW1ROCK",  "SW2ROCK"},  {"SW1MET2",  "SW2MET2"},  {"SW1WDMET", "SW2WDMET"},
+    {"SW1BRIK",  "SW2BRIK"},  {"SW1MOD1",  "SW2MOD1"},  {"SW1ZIM",   "SW2ZIM"},
+    {"SW1STON6", "SW2STON6"}, {"SW1TEK",   "SW2TEK"},   {"SW1MARB",  "SW2MARB"},
+    {"SW1SKULL", "SW2SKULL"},
+};
+
+#define NUM_TEX_ANIM_DEFS (sizeof tex_anim_defs / sizeof tex_anim_defs[0])
+#define NUM_SWITCH_DEFS (sizeof switch_defs / sizeof switch_defs[0])
+
+static anim_table flat_table, wall_table;
+static GLint texture_buffer_alignment;
+static int anim_tic;
+static int last_step;
+
+static void init_table(anim_table* table, size_t num);
+static void apply_step(int step);
+static GLuint get_texture(anim_table* table);
+static void stream_table(anim_table* table);
+static int find_flat(const flat_tex* flats, size_t num_flats, const char* name);
+static int find_wall(const wall_tex* textures, size_t num_textures, const char* name);
+
+void anim_init(const flat_tex* flats, size_t num_flats, const wall_tex* textures, size_t num_textures)
+{
+    for (int i = 0; i < NUM_TEX_ANIM_DEFS; i++)
+    {
+        tex_anim_def* def = &tex_anim_defs[i];
+        if (def->is_wall)
+        {
+            def->start = find_wall(textures, num_textures, def->start_name);
+            def->end = find_wall(textures, num_textures, def->end_name);
+        }
+        else
+        {
+            def->start = find_flat(flats, num_flats, def->start_name);
+            def->end = find_flat(flats, num_flats, def->end_name);
+        }
+    }
+
+    init_table(&flat_table, num_flats);
+    init_table(&wall_table, num_textures);
+
+    // Fresh tables pick up the current phase
+    last_step = anim_tic / TEX_ANIM_TICS;
+    apply_step(last_step);
+}
 
-void update_animation(float dt)
+void update_animation()
 {
-    for (flat_anim_t* anim = flat_anim; anim != NULL; anim = anim->next)
+    anim_tic++;
+    int step = anim_tic / TEX_ANIM_TICS;
+    if (step == last_step)
+        return;
+
+    last_step = step;
+    apply_step(step);
+}
+
+void apply_step(int step)
+{
+    // Same rotation as vanilla: every frame of a sequence advances, so any member can be the base
+    for (int i = 0; i < NUM_TEX_ANIM_DEFS; i++)
+    {
+        const tex_anim_def* def = &tex_anim_defs[i];
+        if (def->start < 0 || def->end < def->start)
+            continue;
+
+        anim_table* table = def->is_wall ? &wall_table : &flat_table;
+        int num_frames = def->end - def->start + 1;
+        for (int tex = def->start; tex <= def->end; tex++)
+            table->translation[tex] = def->start + (tex - def->start + step) % num_frames;
+    }
+}
+
+void anim_expand_residency(const wad* wad, bool* flats_used, size_t num_flats, const wall_tex* textures, bool* walls_used, size_t num_textures)
+{
+    int f_start = wad_find_lump("F_START", wad);
+
+    for (int i = 0; i < NUM_TEX_ANIM_DEFS; i++)
     {
-        anim->time += dt;
-        if (anim->time < TEX_ANIM_TIME) continue;
+        const tex_anim_def* def = &tex_anim_defs[i];
+        int start, end;
+        bool* used;
+        if (def->is_wall)
+        {
+            start = find_wall(textures, num_textures, def->start_name);
+            end = find_wall(textures, num_textures, def->end_name);
+            used = walls_used;
+        }
+        else
+        {
+            start = wad_find_lump(def->start_name, wad) - f_start - 1;
+            end = wad_find_lump(def->end_name, wad) - f_start - 1;
+            if (end >= (int)num_flats)
+                continue;
+            used = flats_used;
+        }
 
-        anim->time -= TEX_ANIM_TIME;
+        if (start < 0 || end < start)
+            continue;
 
-        glBindBuffer(GL_ARRAY_BUFFER, anim->mesh->vbo);
-        void* ptr = glMapBuffer(GL_ARRAY_BUFFER, GL_READ_WRITE);
+        bool is_used = false;
+        for (int tex = start; tex <= end; tex++)
+            is_used |= used[tex];
 
-        for (size_t i = anim->vertex_index_start; i < anim->vertex_index_end; i++)
+        // Frames are addressed as a contiguous range, so the whole range comes along
+        if (is_used)
         {
-            int* tex = (char*)ptr + i * sizeof(vertex) + offsetof(vertex, texture_index);
-            if (++*tex > anim->max_tex)
-                *tex = anim->min_tex;
+            for (int tex = start; tex <= end; tex++)
+                used[tex] = true;
         }
+    }
+
+    for (int i = 0; i < NUM_SWITCH_DEFS; i++)
+    {
+        int off = find_wall(textures, num_textures, switch_defs[i].off_name);
+        int on = find_wall(textures, num_textures, switch_defs[i].on_name);
+        if (off < 0 || on < 0)
+            continue;
 
-        glUnmapBuffer(GL_ARRAY_BUFFER);
+        if (walls_used[off] || walls_used[on])
+            walls_used[off] = walls_used[on] = true;
     }
 }
 
-void add_tex_anim(mesh* mesh, size_t vertex_index_start, size_t vertex_index_end, int min_tex, int max_tex)
+void anim_stream_tables()
 {
-    flat_anim_t* anim = malloc(sizeof(flat_anim_t));
-    *flat_anim_ptr = anim;
-    flat_anim_ptr = &anim->next;
+    // Only the GL renderer streams, the software renderer reads the translations directly
+    if (texture_buffer_alignment == 0)
+        glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &texture_buffer_alignment);
+    stream_table(&flat_table);
+    stream_table(&wall_table);
+}
+
+GLuint anim_get_flat_table()
+{
+    return get_texture(&flat_table);
+}
+
+GLuint anim_get_wall_table()
+{
+    return get_texture(&wall_table);
+}
+
+const int32_t* anim_get_flat_translation()
+{
+    return flat_table.translation;
+}
+
+const int32_t* anim_get_wall_translation()
+{
+    return wall_table.translation;
+}
+
+void init_table(anim_table* table, size_t num)
+{
+    // Tables are rebuilt whenever the resident texture set grows
+    free(table->translation);
+
+    table->num = num;
+    table->translation = malloc(sizeof(int32_t) * (num > 0 ? num : 1));
+    for (size_t i = 0; i < num; i++)
+        table->translation[i] = (int32_t)i;
+}
+
+// Made on first use so the software renderer never needs a GL context
+GLuint get_texture(anim_table* table)
+{
+    if (table->texture == 0)
+        glGenTextures(1, &table->texture);
+    return table->texture;
+}
+
+void stream_table(anim_table* table)
+{
+    if (table->num == 0)
+        return;
+
+    size_t size = sizeof(int32_t) * table->num;
+    stream_allocation alloc = stream_buffer_alloc(size, texture_buffer_alignment);
+    if (alloc.data == NULL)
+        return;
+
+    memcpy(alloc.data, table->translation, size);
+
+    glBindTexture(GL_TEXTURE_BUFFER, table->texture);
+    glTexBufferRange(GL_TEXTURE_BUFFER, GL_R32I, alloc.buffer, alloc.offset, size);
+}
+
+int find_flat(const flat_tex* flats, size_t num_flats, const char* name)
+{
+    for (int i = 0; i < num_flats; i++)
+    {
+        if (strncmp_nocase(flats[i].name, name, 8) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+int find_wall(const wall_tex* textures, size_t num_textures, const char* name)
+{
+    for (int i = 0; i < num_textures; i++)
+    {
+        if (strncmp_nocase(textures[i].name, name, 8) == 0)
+            return i;
+    }
 
-    *anim = (flat_anim_t){
-        mesh, vertex_index_start, vertex_index_end, min_tex, max_tex, 0.f, NULL,
-    };
+    return -1;
 }
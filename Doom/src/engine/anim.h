@@ -1,21 +1,47 @@
 #pragma once
-#include "mesh.h"
+#include "glad/glad.h"
+#include "wad_loader.h"
+#include "texture/flat_texture.h"
+#include "texture/wall_texture.h"
+
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#define TIC_RATE 35
+#define TEX_ANIM_TICS 8
 
-#define TEX_ANIM_TIME (8.0f / 35.0f)
+typedef struct tex_anim_def
+{
+    bool is_wall;
+    const char* end_name;
+    const char* start_name;
+    int start;
+    int end;
+} tex_anim_def;
 
-typedef struct tex_anim
+typedef struct switch_def
 {
-    mesh* mesh;
-    size_t vertex_index_start;
-    size_t vertex_index_end;
-    int min_tex;
-    int max_tex;
-    float time;
+    const char* off_name;
+    const char* on_name;
+} switch_def;
+
+// Builds the flat and wall translation tables (base texture index -> current frame) that
+// the world shaders read through a texture buffer over the stream buffer
+void anim_init(const flat_tex* flats, size_t num_flats, const wall_tex* textures, size_t num_textures);
+// Advances the animations by one tic
+void update_animation();
+
+// Marks every frame of a used animation and both states of a used switch, indices are
+// global (TEXTURE1 order, lumps after F_START)
+void anim_expand_residency(const wad* wad, bool* flats_used, size_t num_flats, const wall_tex* textures, bool* walls_used, size_t num_textures);
 
-    struct tex_anim* next;
-} flat_anim_t;
+// Streams both tables for the current frame, call once per frame after renderer_begin_frame()
+void anim_stream_tables();
 
-void update_animation(float dt);
+GLuint anim_get_flat_table();
+GLuint anim_get_wall_table();
 
-void add_tex_anim(mesh* mesh, size_t vertex_index_start, size_t vertex_index_end, int min_tex, int max_tex);
+// CPU side of the same tables, for the software renderer
+const int32_t* anim_get_flat_translation();
+const int32_t* anim_get_wall_translation();
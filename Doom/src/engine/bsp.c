@@ -0,0 +1,282 @@
+#include "engine/bsp.h"
+#include "engine/state.h"
+#include "thread_pool.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BSP_USE_SSE
+#include <emmintrin.h>
+#endif
+
+// a * x + b * y + c, positive inside the subsector
+typedef struct seg_line
+{
+	float a, b, c;
+} seg_line;
+
+typedef struct batch
+{
+	const vec2* positions;
+	size_t count;
+	int* subsectors;
+	int* sectors;
+} batch;
+
+static uint16_t add_node(uint16_t id);
+static int find_sector(const gl_subsector* subsector);
+static vec2 seg_vertex(uint16_t index);
+static bool is_inside(vec2 position, int subsector);
+static void locate_range(const batch* batch, size_t first, size_t count);
+static void locate_job(void* data, int index);
+#ifdef BSP_USE_SSE
+static void locate_4(const vec2* positions, int* subsectors);
+#endif
+
+static bsp_node* nodes;
+static size_t num_nodes;
+static uint16_t root;
+
+static int* subsector_sectors;
+static seg_line* seg_lines; // One per GL seg, each subsector's are contiguous
+static size_t num_subsectors;
+
+void bsp_build()
+{
+	bsp_free();
+
+	nodes = malloc(sizeof(bsp_node) * (gl_m.num_nodes > 0 ? gl_m.num_nodes : 1));
+	num_nodes = 0;
+	// A map of one subsector has no nodes at all
+	root = gl_m.num_nodes > 0 ? add_node(gl_m.num_nodes - 1) : BSP_LEAF;
+
+	num_subsectors = gl_m.num_subsectors;
+	subsector_sectors = malloc(sizeof(int) * (num_subsectors > 0 ? num_subsectors : 1));
+	seg_lines = malloc(sizeof(seg_line) * (gl_m.num_segments > 0 ? gl_m.num_segments : 1));
+	for (size_t i = 0; i < num_subsectors; i++)
+	{
+		const gl_subsector* subsector = &gl_m.subsectors[i];
+		subsector_sectors[i] = find_sector(subsector);
+
+		if (subsector->num_segs == 0 || subsector->first_seg + subsector->num_segs > gl_m.num_segments)
+			continue;
+
+		// Subsectors are convex, the centroid tells which side of each seg is in
+		vec2 centroid = { 0.0f, 0.0f };
+		for (int j = 0; j < subsector->num_segs; j++)
+			centroid = vec2_add(centroid, seg_vertex(gl_m.segments[subsector->first_seg + j].start_vertex));
+		centroid.x /= subsector->num_segs;
+		centroid.y /= subsector->num_segs;
+
+		for (int j = 0; j < subsector->num_segs; j++)
+		{
+			const gl_segment* segment = &gl_m.segments[subsector->first_seg + j];
+			vec2 start = seg_vertex(segment->start_vertex);
+			vec2 end = seg_vertex(segment->end_vertex);
+
+			seg_line* line = &seg_lines[subsector->first_seg + j];
+			float length = hypotf(end.x - start.x, end.y - start.y);
+			if (length == 0.0f)
+			{
+				// Never the reason a point is outside
+				*line = (seg_line){ 0.0f, 0.0f, FLT_MAX };
+				continue;
+			}
+
+			line->a = -(end.y - start.y) / length;
+			line->b = (end.x - start.x) / length;
+			line->c = -(line->a * start.x + line->b * start.y);
+			if (line->a * centroid.x + line->b * centroid.y + line->c < 0.0f)
+				*line = (seg_line){ -line->a, -line->b, -line->c };
+		}
+	}
+}
+
+void bsp_free()
+{
+	free(nodes);
+	free(subsector_sectors);
+	free(seg_lines);
+	nodes = NULL;
+	subsector_sectors = NULL;
+	seg_lines = NULL;
+	num_nodes = num_subsectors = 0;
+	root = BSP_LEAF;
+}
+
+size_t bsp_get_heap_bytes()
+{
+	return sizeof(bsp_node) * num_nodes + sizeof(int) * num_subsectors + sizeof(seg_line) * gl_m.num_segments;
+}
+
+int bsp_locate(vec2 position)
+{
+	uint16_t id = root;
+	while ((id & BSP_LEAF) == 0)
+	{
+		const bsp_node* node = &nodes[id];
+		vec2 delta = vec2_sub(position, node->partition);
+		bool is_on_back = (delta.x * node->delta.y - delta.y * node->delta.x) <= 0.f;
+		id = node->children[is_on_back];
+	}
+
+	int subsector = id & ~BSP_LEAF;
+	return subsector < num_subsectors ? subsector : -1;
+}
+
+int bsp_locate_from(vec2 position, int hint)
+{
+	if (hint >= 0 && hint < num_subsectors && is_inside(position, hint))
+		return hint;
+
+	return bsp_locate(position);
+}
+
+void bsp_locate_batch(const vec2* positions, size_t count, int* subsectors, int* sectors)
+{
+	batch batch = { positions, count, subsectors, sectors };
+	if (count <= BSP_BATCH_JOB_SIZE || thread_pool_get_num_threads() <= 1)
+	{
+		locate_range(&batch, 0, count);
+		return;
+	}
+
+	thread_pool_run(locate_job, &batch, (int)((count + BSP_BATCH_JOB_SIZE - 1) / BSP_BATCH_JOB_SIZE));
+}
+
+int bsp_get_sector(int subsector)
+{
+	return subsector >= 0 && subsector < num_subsectors ? subsector_sectors[subsector] : -1;
+}
+
+// Copies the subtree under a GL_NODES id depth first and returns its new id
+uint16_t add_node(uint16_t id)
+{
+	if (id & BSP_LEAF)
+		return id;
+	// Out of range children locate nothing instead of reading past the array
+	if (id >= gl_m.num_nodes || num_nodes >= gl_m.num_nodes)
+		return BSP_LEAF | 0x7fff;
+
+	const gl_node* node = &gl_m.nodes[id];
+	uint16_t index = num_nodes++;
+	nodes[index].partition = node->partition;
+	nodes[index].delta = node->delta_partition;
+
+	uint16_t front = add_node(node->front_child_id);
+	uint16_t back = add_node(node->back_child_id);
+	nodes[index].children[0] = front;
+	nodes[index].children[1] = back;
+	return index;
+}
+
+// The sector on the side of the first seg that lies on a linedef, minisegs have none
+int find_sector(const gl_subsector* subsector)
+{
+	for (int i = 0; i < subsector->num_segs; i++)
+	{
+		size_t seg_index = subsector->first_seg + i;
+		if (seg_index >= gl_m.num_segments)
+			break;
+
+		const gl_segment* segment = &gl_m.segments[seg_index];
+		if (segment->linedef >= m.num_linedefs)
+			continue;
+
+		const linedef* linedef = &m.linedefs[segment->linedef];
+		uint16_t sidedef = segment->side == 0 ? linedef->front_sidedef : linedef->back_sidedef;
+		if (sidedef < m.num_sidedefs && m.sidedefs[sidedef].sector_index < m.num_sectors)
+			return m.sidedefs[sidedef].sector_index;
+	}
+
+	return -1;
+}
+
+vec2 seg_vertex(uint16_t index)
+{
+	if (index & VERT_IS_GL)
+		return gl_m.vertices[index & 0x7fff];
+	return m.vertices[index];
+}
+
+bool is_inside(vec2 position, int subsector)
+{
+	const gl_subsector* ss = &gl_m.subsectors[subsector];
+	if (ss->num_segs < 3 || ss->first_seg + ss->num_segs > gl_m.num_segments)
+		return false;
+
+	const seg_line* lines = &seg_lines[ss->first_seg];
+	for (int i = 0; i < ss->num_segs; i++)
+	{
+		if (lines[i].a * position.x + lines[i].b * position.y + lines[i].c <= BSP_INSIDE_MARGIN)
+			return false;
+	}
+	return true;
+}
+
+void locate_range(const batch* batch, size_t first, size_t count)
+{
+	size_t i = first;
+	size_t end = first + count;
+#ifdef BSP_USE_SSE
+	for (; i + 4 <= end; i += 4)
+		locate_4(&batch->positions[i], &batch->subsectors[i]);
+#endif
+	for (; i < end; i++)
+		batch->subsectors[i] = bsp_locate(batch->positions[i]);
+
+	if (batch->sectors != NULL)
+	{
+		for (i = first; i < end; i++)
+			batch->sectors[i] = bsp_get_sector(batch->subsectors[i]);
+	}
+}
+
+void locate_job(void* data, int index)
+{
+	const batch* batch = data;
+	size_t first = (size_t)index * BSP_BATCH_JOB_SIZE;
+	size_t count = batch->count - first < BSP_BATCH_JOB_SIZE ? batch->count - first : BSP_BATCH_JOB_SIZE;
+	locate_range(batch, first, count);
+}
+
+#ifdef BSP_USE_SSE
+// One lane per position, each walks its own path and the side tests of all four run together.
+// Lanes that reached a leaf read the root and ignore the result until the others catch up
+void locate_4(const vec2* positions, int* subsectors)
+{
+	__m128 x = _mm_setr_ps(positions[0].x, positions[1].x, positions[2].x, positions[3].x);
+	__m128 y = _mm_setr_ps(positions[0].y, positions[1].y, positions[2].y, positions[3].y);
+	uint16_t ids[4] = { root, root, root, root };
+
+	while (((ids[0] & ids[1] & ids[2] & ids[3]) & BSP_LEAF) == 0)
+	{
+		const bsp_node* n[4];
+		for (int i = 0; i < 4; i++)
+			n[i] = &nodes[(ids[i] & BSP_LEAF) ? 0 : ids[i]];
+
+		__m128 delta_x = _mm_sub_ps(x, _mm_setr_ps(n[0]->partition.x, n[1]->partition.x, n[2]->partition.x, n[3]->partition.x));
+		__m128 delta_y = _mm_sub_ps(y, _mm_setr_ps(n[0]->partition.y, n[1]->partition.y, n[2]->partition.y, n[3]->partition.y));
+		__m128 partition_dx = _mm_setr_ps(n[0]->delta.x, n[1]->delta.x, n[2]->delta.x, n[3]->delta.x);
+		__m128 partition_dy = _mm_setr_ps(n[0]->delta.y, n[1]->delta.y, n[2]->delta.y, n[3]->delta.y);
+		__m128 cross = _mm_sub_ps(_mm_mul_ps(delta_x, partition_dy), _mm_mul_ps(delta_y, partition_dx));
+		int is_on_back = _mm_movemask_ps(_mm_cmple_ps(cross, _mm_setzero_ps()));
+
+		for (int i = 0; i < 4; i++)
+		{
+			if ((ids[i] & BSP_LEAF) == 0)
+				ids[i] = n[i]->children[(is_on_back >> i) & 1];
+		}
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		int subsector = ids[i] & ~BSP_LEAF;
+		subsectors[i] = subsector < num_subsectors ? subsector : -1;
+	}
+}
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+#include "math/vector.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BSP_LEAF 0x8000		// Child is a subsector, as in GL_NODES
+#define BSP_INSIDE_MARGIN 0.01f	// Map units a hinted query must be inside its old subsector by
+#define BSP_BATCH_JOB_SIZE 4096	// Positions per thread pool job, smaller batches stay on the caller
+
+// Only what point location reads. Nodes are stored depth first from the root at 0, so the front
+// child of a node usually sits right after it
+typedef struct bsp_node
+{
+	vec2 partition, delta;
+	uint16_t children[2]; // Front, back
+} bsp_node;
+
+// Builds the node array and the subsector tables from gl_m and m, after a map is loaded
+void bsp_build();
+void bsp_free();
+size_t bsp_get_heap_bytes();
+
+// Subsector containing position, -1 when the map has none
+int bsp_locate(vec2 position);
+// Returns hint, the subsector of an earlier query, without walking the tree while position is
+// still well inside it
+int bsp_locate_from(vec2 position, int hint);
+// Sector of a subsector, -1 when none of its segs lie on a linedef
+int bsp_get_sector(int subsector);
+
+// Locates every position, four at a time with SSE where available, matching bsp_locate exactly.
+// sectors may be NULL. Batches of more than one job are spread over the thread pool, so this must
+// not be called from inside a pool job
+void bsp_locate_batch(const vec2* positions, size_t count, int* subsectors, int* sectors);
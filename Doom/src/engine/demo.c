@@ -0,0 +1,246 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L // strnlen
+#endif
+
+#include "demo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEMO_MAGIC "DDEM"
+#define DEMO_HEADER_SIZE 13 // Magic, version, map name padded to 8
+#define DEMO_FOOTER_SIZE 8  // Tic count, state hash
+
+enum
+{
+	DEMO_HAS_FORWARD = 1 << 0,
+	DEMO_HAS_SIDE = 1 << 1,
+	DEMO_HAS_TURN = 1 << 2,
+	DEMO_HAS_LOOK = 1 << 3,
+	DEMO_HAS_BUTTONS = 1 << 4,
+	DEMO_END = 0x80
+};
+
+static void write_u16(uint16_t value);
+static void write_u32(uint32_t value);
+static uint16_t read_u16();
+static uint32_t read_u32();
+static bool can_read(size_t size);
+
+static FILE* record_file;
+static int num_recorded;
+
+static uint8_t* data;
+static size_t data_size, offset;
+static int num_played;
+static bool is_finished;
+
+bool demo_record(const char* filename, const char* mapname)
+{
+	record_file = fopen(filename, "wb");
+	if (record_file == NULL)
+	{
+		fprintf(stderr, "Failed to open demo '%s' for writing\n", filename);
+		return false;
+	}
+
+	char name[8] = { 0 };
+	memcpy(name, mapname, strnlen(mapname, 8));
+	fwrite(DEMO_MAGIC, 1, 4, record_file);
+	fputc(DEMO_VERSION, record_file);
+	fwrite(name, 1, 8, record_file);
+
+	num_recorded = 0;
+	return true;
+}
+
+bool demo_play(const char* filename, char mapname[DEMO_MAPNAME_SIZE])
+{
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open demo '%s'\n", filename);
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	data_size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data = malloc(data_size > 0 ? data_size : 1);
+	size_t num_read = fread(data, 1, data_size, file);
+	fclose(file);
+
+	if (num_read != data_size || data_size < DEMO_HEADER_SIZE + 1 + DEMO_FOOTER_SIZE || memcmp(data, DEMO_MAGIC, 4) != 0)
+	{
+		fprintf(stderr, "'%s' is not a demo\n", filename);
+		free(data);
+		data = NULL;
+		return false;
+	}
+	if (data[4] != DEMO_VERSION)
+	{
+		fprintf(stderr, "Demo '%s' is version %d, expected %d\n", filename, data[4], DEMO_VERSION);
+		free(data);
+		data = NULL;
+		return false;
+	}
+
+	memcpy(mapname, data + 5, 8);
+	mapname[8] = 0;
+
+	offset = DEMO_HEADER_SIZE;
+	num_played = 0;
+	is_finished = false;
+	return true;
+}
+
+bool demo_is_recording()
+{
+	return record_file != NULL;
+}
+
+bool demo_is_playing()
+{
+	return data != NULL;
+}
+
+bool demo_is_finished()
+{
+	return is_finished;
+}
+
+void demo_write_tic(const ticcmd* cmd)
+{
+	if (record_file == NULL)
+		return;
+
+	uint8_t flags = (cmd->forward != 0 ? DEMO_HAS_FORWARD : 0) |
+		(cmd->side != 0 ? DEMO_HAS_SIDE : 0) |
+		(cmd->turn != 0 ? DEMO_HAS_TURN : 0) |
+		(cmd->look != 0 ? DEMO_HAS_LOOK : 0) |
+		(cmd->buttons != 0 ? DEMO_HAS_BUTTONS : 0);
+
+	fputc(flags, record_file);
+	if (flags & DEMO_HAS_FORWARD)
+		fputc((uint8_t)cmd->forward, record_file);
+	if (flags & DEMO_HAS_SIDE)
+		fputc((uint8_t)cmd->side, record_file);
+	if (flags & DEMO_HAS_TURN)
+		write_u16((uint16_t)cmd->turn);
+	if (flags & DEMO_HAS_LOOK)
+		write_u16((uint16_t)cmd->look);
+	if (flags & DEMO_HAS_BUTTONS)
+		fputc(cmd->buttons, record_file);
+
+	num_recorded++;
+}
+
+bool demo_read_tic(ticcmd* cmd)
+{
+	if (data == NULL || is_finished)
+		return false;
+
+	*cmd = (ticcmd){ 0 };
+
+	uint8_t flags = can_read(1) ? data[offset++] : DEMO_END;
+	if (flags & DEMO_END)
+	{
+		offset--;
+		is_finished = true;
+		return false;
+	}
+
+	size_t size = ((flags & DEMO_HAS_FORWARD) ? 1 : 0) + ((flags & DEMO_HAS_SIDE) ? 1 : 0) +
+		((flags & DEMO_HAS_TURN) ? 2 : 0) + ((flags & DEMO_HAS_LOOK) ? 2 : 0) + ((flags & DEMO_HAS_BUTTONS) ? 1 : 0);
+	if (!can_read(size))
+	{
+		fprintf(stderr, "Demo is truncated at tic %d\n", num_played);
+		is_finished = true;
+		return false;
+	}
+
+	if (flags & DEMO_HAS_FORWARD)
+		cmd->forward = (int8_t)data[offset++];
+	if (flags & DEMO_HAS_SIDE)
+		cmd->side = (int8_t)data[offset++];
+	if (flags & DEMO_HAS_TURN)
+		cmd->turn = (int16_t)read_u16();
+	if (flags & DEMO_HAS_LOOK)
+		cmd->look = (int16_t)read_u16();
+	if (flags & DEMO_HAS_BUTTONS)
+		cmd->buttons = data[offset++];
+
+	num_played++;
+	return true;
+}
+
+void demo_end(uint32_t state_hash)
+{
+	if (record_file != NULL)
+	{
+		fputc(DEMO_END, record_file);
+		write_u32(num_recorded);
+		write_u32(state_hash);
+		fclose(record_file);
+		record_file = NULL;
+
+		printf("Demo: recorded %d tics\n", num_recorded);
+	}
+
+	if (data != NULL)
+	{
+		if (!is_finished)
+		{
+			printf("Demo: stopped at tic %d\n", num_played);
+		}
+		else if (offset + 1 + DEMO_FOOTER_SIZE <= data_size && data[offset] == DEMO_END)
+		{
+			offset++;
+			uint32_t num_tics = read_u32();
+			uint32_t expected_hash = read_u32();
+			if (num_tics == num_played && expected_hash == state_hash)
+				printf("Demo: played %d tics, in sync\n", num_played);
+			else
+				printf("Demo: played %d of %u tics, desynced (state %08x, recorded %08x)\n", num_played, num_tics, state_hash, expected_hash);
+		}
+		else
+		{
+			printf("Demo: played %d tics, no footer to check against\n", num_played);
+		}
+
+		free(data);
+		data = NULL;
+	}
+}
+
+void write_u16(uint16_t value)
+{
+	fputc(value & 0xff, record_file);
+	fputc(value >> 8, record_file);
+}
+
+void write_u32(uint32_t value)
+{
+	write_u16(value & 0xffff);
+	write_u16(value >> 16);
+}
+
+uint16_t read_u16()
+{
+	uint16_t value = data[offset] | (data[offset + 1] << 8);
+	offset += 2;
+	return value;
+}
+
+uint32_t read_u32()
+{
+	uint32_t low = read_u16();
+	return low | ((uint32_t)read_u16() << 16);
+}
+
+bool can_read(size_t size)
+{
+	return offset + size <= data_size;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "engine/engine.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DEMO_VERSION 1
+#define DEMO_MAPNAME_SIZE 9
+
+// A demo is the map name followed by one ticcmd per tic. Each tic is a byte of flags telling which
+// fields are non-zero and then only those fields, so idle tics cost one byte. The footer holds the
+// number of tics and a hash of the player state after the last one, playback compares against it
+// to catch anything that made the simulation diverge
+bool demo_record(const char* filename, const char* mapname);
+// Loads the whole demo and writes its map name into mapname
+bool demo_play(const char* filename, char mapname[DEMO_MAPNAME_SIZE]);
+
+bool demo_is_recording();
+bool demo_is_playing();
+// Playback ran out of tics
+bool demo_is_finished();
+
+void demo_write_tic(const ticcmd* cmd);
+// False once every tic has been read
+bool demo_read_tic(ticcmd* cmd);
+
+// Closes the demo, a recording gets its footer written and a playback reports whether it stayed in sync
+void demo_end(uint32_t state_hash);
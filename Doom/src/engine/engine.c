@@ -7,13 +7,21 @@
 #include "mesh.h"
 #include "palette.h"
 #include "renderer.h"
+#include "render_queue.h"
+#include "stream_buffer.h"
 #include "utils.h"
 #include "wad_loader.h"
+#include "software/software_renderer.h"
 #include "texture/flat_texture.h"
 #include "texture/wall_texture.h"
 #include "engine/state.h"
 #include "engine/utilities.h"
 #include "engine/anim.h"
+#include "engine/bsp.h"
+#include "engine/demo.h"
+#include "engine/map_stats.h"
+#include "engine/residency.h"
+#include "math/frustum.h"
 #include "math/matrix.h"
 #include "math/vector.h"
 
@@ -27,14 +35,23 @@
 #include <string.h>
 
 #define FOV (M_PI / 2.0f)	// 90 degrees
+#define NEAR_PLANE (0.1f)
+#define FAR_PLANE (10000.0f)
 #define PLAYER_SPEED (500.0f)
 #define MOUSE_SENSITIVITY (0.002f) // in radians
+#define KEY_TURN_SPEED (4.0f) // radians per second
+#define MAX_TICS_PER_UPDATE 10
 
-static void render_node(draw_node* node);
+static void init_gl();
+static void load_textures(map* map);
+static ticcmd build_ticcmd();
+static camera interpolate_camera();
+static void snap_to_floor(vec2 position);
+static void render_node(draw_node* node, const frustum* view_frustum);
+static void render_sky_mask(const frustum* view_frustum, mat4 view_projection);
 
 size_t num_flats, num_wall_textures, num_palettes;
 wall_tex_info* wall_textures_info;
-vec2* wall_max_coords;
 
 map m;
 gl_map gl_m;
@@ -43,27 +60,83 @@ float max_sector_height;
 int sky_flat;
 
 draw_node* root_draw_node;
-stencil_list stencil_ls;
+stencil_quad_array stencil_quads;
 mesh quad_mesh;
 
-size_t num_tex_anim_defs;
-tex_anim_def tex_anim_defs[] = {
-	{"NUKAGE3", "NUKAGE1"},
-	{"FWATER4", "FWATER1"},
-	{"SWATER4", "SWATER1"},
-	{"LAVA4",	"LAVA1"},
-	{"BLOOD3",	"BLOOD1"},
+// Program used for each surface type of a subsector mesh
+static const int surface_shaders[NUM_SURFACE_TYPES] = {
+	[SURFACE_FLAT] = SHADER_FLAT,
+	[SURFACE_WALL] = SHADER_WALL
 };
 
-static camera cam;
+static camera cam, prev_cam, render_cam;
 static vec2 last_mouse;
+static mat4 projection;
+
+static wad* current_wad;
+static char current_mapname[9];
+static int palette_index = 0;
+static double tic_accumulator;
+static int game_tic;
+static float tic_alpha;
+static int cam_subsector = -1; // Where the last floor lookup found the player
+static float pending_turn, pending_look; // Radians not yet handed to a tic
+
+static palette* palettes;
+static GLuint flat_texture_array, sky_cubemap;
+static wall_atlas atlas;
+static bool has_sky_mask_overflowed; // Reported once per map
 
 void engine_init(wad* wad, const char* mapname)
+{
+	current_wad = wad;
+
+	palettes = wad_read_playpal(&num_palettes, wad);
+	size_t num_colormaps = 0;
+	colormap* colormaps = wad_read_colormaps(&num_colormaps, wad);
+	if (software_renderer_is_enabled())
+		software_renderer_set_palettes(palettes, num_palettes, colormaps, num_colormaps);
+	else
+		renderer_set_palette_texture(palettes_generate_colormap_texture(palettes, num_palettes, colormaps, num_colormaps));
+	free(colormaps);
+
+	residency_init(wad);
+	residency_require_wall("SKY1");
+	residency_require_flat("F_SKY1");
+
+	darray_init(stencil_quads, 0);
+
+	// The CPU renderer draws straight from the map, there is no GL context to set up
+	if (!software_renderer_is_enabled())
+		init_gl();
+
+	engine_load_map(mapname);
+}
+
+void init_gl()
 {
 	vec2 size = renderer_get_size();
-	mat4 projection = mat4_perspective(FOV, size.x / size.y, 0.1f, 10000.0f);
+	projection = mat4_perspective(FOV, size.x / size.y, NEAR_PLANE, FAR_PLANE);
 	renderer_set_projection(projection);
+	renderer_set_palettes(palettes, num_palettes);
 
+	vec3 stencil_quad_vertices[] = {
+		{0.0f, 0.0f, 0.0f},
+		{0.0f, 1.0f, 0.0f},
+		{1.0f, 1.0f, 0.0f},
+		{1.0f, 0.0f, 0.0f}
+	};
+
+	uint32_t stencil_quad_indices[] = { 0, 2, 1, 0, 3, 2 };
+
+	mesh_create(&quad_mesh, VERTEX_LAYOUT_PLAIN, 4, stencil_quad_vertices, 6, stencil_quad_indices, false);
+
+	// Instances are streamed every frame, draws select their slice through the base instance
+	mesh_add_instance_transforms(&quad_mesh, stream_buffer_get_buffer());
+}
+
+bool engine_load_map(const char* mapname)
+{
 	char* gl_mapname = malloc(strlen(mapname) + 4);
 	gl_mapname[0] = 'G';
 	gl_mapname[1] = 'L';
@@ -71,56 +144,35 @@ void engine_init(wad* wad, const char* mapname)
 	gl_mapname[3] = 0;
 	strcat(gl_mapname, mapname);
 
-	if (wad_read_gl_map(gl_mapname, &gl_m, wad) != 0)
-	{
-		fprintf(stderr, "Failed to read GL info for map '%s' from WAD file\n", mapname);
-		return;
-	}
-
-	palette* palettes = wad_read_playpal(&num_palettes, wad);
-	GLuint palette_texture = palettes_generate_texture(palettes, num_palettes);
+	snprintf(current_mapname, sizeof(current_mapname), "%s", mapname);
 
-	sky_flat = wad_find_lump("F_SKY1", wad) - wad_find_lump("F_START", wad) - 1;
+	// Everything of the previous map goes, the resident textures stay and only grow
+	free_meshes();
+	bsp_free();
+	wad_free_map(&m);
+	wad_free_gl_map(&gl_m);
 
-	num_tex_anim_defs = sizeof tex_anim_defs / sizeof tex_anim_defs[0];
-	for (int i = 0; i < num_tex_anim_defs; i++)
-		tex_anim_defs[i].start = tex_anim_defs[i].end = -1;
-
-	flat_tex* flats = wad_read_flats(&num_flats, wad);
-	GLuint flat_texture_array = generate_flat_texture_array(flats, num_flats);
-	for (int i = 0; i < num_flats; i++)
+	int result = wad_read_gl_map(gl_mapname, &gl_m, current_wad);
+	free(gl_mapname);
+	if (result != 0)
 	{
-		for (int j = 0; j < num_tex_anim_defs; j++)
-		{
-			if (strcmp_nocase(flats[i].name, tex_anim_defs[j].start_name) == 0)
-				tex_anim_defs[j].start = i;
-
-			if (strcmp_nocase(flats[i].name, tex_anim_defs[j].end_name) == 0)
-				tex_anim_defs[j].end = i;
-		}
-	}
-	free(flats);
-
-	wall_tex* textures = wad_read_textures(&num_wall_textures, "TEXTURE1", wad);
-	wall_textures_info = malloc(sizeof(wall_tex_info) * num_wall_textures);
-	wall_max_coords = malloc(sizeof(vec2) * num_wall_textures);
-	for (int i = 0; i < num_wall_textures; i++)
-	{
-		if (strcmp_nocase(textures[i].name, "SKY1") == 0)
-			renderer_set_sky_texture(generate_texture_cubemap(&textures[i]));
-
-		wall_textures_info[i] = (wall_tex_info){ textures[i].width, textures[i].height };
+		fprintf(stderr, "Failed to read GL info for map '%s' from WAD file\n", mapname);
+		return false;
 	}
 
-	GLuint wall_texture_array = generate_wall_texture_array(textures, num_wall_textures, wall_max_coords);
-	wad_free_wall_textures(textures, num_wall_textures);
-
-	if (wad_read_map(mapname, &m, wad, textures, num_wall_textures) != 0)
+	size_t num_texture_defs;
+	const wall_tex* texture_defs = residency_get_texture_defs(&num_texture_defs);
+	if (wad_read_map(mapname, &m, current_wad, texture_defs, num_texture_defs) != 0)
 	{
 		fprintf(stderr, "Failed to read map '%s' from WAD file\n", mapname);
-		return;
+		return false;
 	}
 
+	bsp_build();
+	cam_subsector = -1;
+	load_textures(&m);
+	sky_flat = residency_get_flat(wad_find_lump("F_SKY1", current_wad) - wad_find_lump("F_START", current_wad) - 1);
+
 	for (int i = 0; i < m.num_things; i++)
 	{
 		thing* thing = &m.things[i];
@@ -151,27 +203,19 @@ void engine_init(wad* wad, const char* mapname)
 		}
 	}
 
-	stencil_ls = (stencil_list){ NULL, NULL };
-	generate_meshes();
-
-	renderer_set_flat_texture(flat_texture_array);
-	renderer_set_wall_texture(wall_texture_array);
-	renderer_set_palette_texture(palette_texture);
-
-	vec3 stencil_quad_vertices[] = {
-		{0.0f, 0.0f, 0.0f},
-		{0.0f, 1.0f, 0.0f},
-		{1.0f, 1.0f, 0.0f},
-		{1.0f, 0.0f, 0.0f}
-	};
-
-	uint32_t stencil_quad_indices[] = { 0, 2, 1, 0, 3, 2 };
-
-	mesh_create(&quad_mesh, VERTEX_LAYOUT_PLAIN, 4, stencil_quad_vertices, 6, stencil_quad_indices, false);
+	camera_update_direction_vectors(&cam);
+	prev_cam = render_cam = cam;
+	tic_accumulator = 0.0;
+	tic_alpha = 0.0f;
+	has_sky_mask_overflowed = false;
+
+	if (!software_renderer_is_enabled())
+		generate_meshes();
+	return true;
 }
 
-static int palette_index = 0;
-void engine_update(float dt)
+
+void engine_update(double dt)
 {
 	if (is_button_just_pressed(KEY_MINUS))
 		palette_index--;
@@ -180,44 +224,11 @@ void engine_update(float dt)
 
 	palette_index = min(max(palette_index, 0), num_palettes - 1);
 
-	camera_update_direction_vectors(&cam);
-
-	vec2 position = { cam.position.x, cam.position.z };
-	sector* sector = map_get_sector(position);
-	if (sector)
-		cam.position.y = sector->floor + player_height;
-
-	float speed = (is_button_pressed(KEY_LSHIFT) ? PLAYER_SPEED * 1.7f : PLAYER_SPEED) * dt;
-
-	vec3 forward = cam.forward;
-	vec3 right = cam.right;
-	forward.y = right.y = 0.0f;
-	forward = vec3_normalize(forward);
-	right = vec3_normalize(right);
-
-	if (is_button_pressed(KEY_W) || is_button_pressed(KEY_UP))
-		cam.position = vec3_add(cam.position, vec3_scale(forward, speed));
-	if (is_button_pressed(KEY_S) || is_button_pressed(KEY_DOWN))
-		cam.position = vec3_add(cam.position, vec3_scale(forward, -speed));
-	if (is_button_pressed(KEY_A))
-		cam.position = vec3_add(cam.position, vec3_scale(right, -speed));
-	if (is_button_pressed(KEY_D))
-		cam.position = vec3_add(cam.position, vec3_scale(right, speed));
-
-	float turn_speed = 4.0f * dt;
-	if (is_button_pressed(KEY_RIGHT))
-		cam.yaw -= turn_speed;
-	if (is_button_pressed(KEY_LEFT))
-		cam.yaw += turn_speed;
-
 	if (is_button_pressed(KEY_ESCAPE))
 		set_mouse_captured(0);
 	if (is_button_pressed(MOUSE_RIGHT))
 		set_mouse_captured(1);
 
-	if (is_button_pressed(KEY_EQUAL))
-		cam.pitch = 0.0f;
-
 	static bool is_first = true;
 	if (is_mouse_captured())
 	{
@@ -228,48 +239,330 @@ void engine_update(float dt)
 		}
 
 		vec2 curr_mouse_pos = get_mouse_position();
-		float dx = curr_mouse_pos.x - last_mouse.x;
-		float dy = last_mouse.y - curr_mouse_pos.y;
+		pending_turn -= (curr_mouse_pos.x - last_mouse.x) * MOUSE_SENSITIVITY;
+		pending_look += (last_mouse.y - curr_mouse_pos.y) * MOUSE_SENSITIVITY;
 		last_mouse = curr_mouse_pos;
-
-		cam.yaw -= dx * MOUSE_SENSITIVITY;
-		cam.pitch += dy * MOUSE_SENSITIVITY;
-		// Clamp the camera vertically
-		cam.pitch = max(-M_PI_2 + 0.05, min(M_PI_2 - 0.05, cam.pitch));
 	}
 	else
 	{
 		is_first = true;
 	}
 
-	update_animation(dt);
+	// Long stalls (loading, a debugger) are dropped instead of replayed tic by tic
+	tic_accumulator = fmin(tic_accumulator + dt, MAX_TICS_PER_UPDATE * TIC_SECONDS);
+	while (tic_accumulator >= TIC_SECONDS)
+	{
+		ticcmd cmd;
+		if (demo_is_playing())
+		{
+			if (!demo_read_tic(&cmd))
+				break;
+		}
+		else
+		{
+			cmd = build_ticcmd();
+		}
+
+		demo_write_tic(&cmd);
+		engine_run_tic(&cmd);
+		tic_accumulator -= TIC_SECONDS;
+	}
+
+	tic_alpha = (float)(tic_accumulator / TIC_SECONDS);
+}
+
+ticcmd build_ticcmd()
+{
+	ticcmd cmd = { 0 };
+
+	int move = (int)lroundf((is_button_pressed(KEY_LSHIFT) ? PLAYER_SPEED * 1.7f : PLAYER_SPEED) / TIC_RATE);
+	if (is_button_pressed(KEY_W) || is_button_pressed(KEY_UP))
+		cmd.forward += move;
+	if (is_button_pressed(KEY_S) || is_button_pressed(KEY_DOWN))
+		cmd.forward -= move;
+	if (is_button_pressed(KEY_A))
+		cmd.side -= move;
+	if (is_button_pressed(KEY_D))
+		cmd.side += move;
+
+	float turn = pending_turn, look = pending_look;
+	if (is_button_pressed(KEY_RIGHT))
+		turn -= KEY_TURN_SPEED / TIC_RATE;
+	if (is_button_pressed(KEY_LEFT))
+		turn += KEY_TURN_SPEED / TIC_RATE;
+
+	// Whatever does not fit a whole angle unit is carried over to the next tic
+	cmd.turn = (int16_t)max(min(lroundf(turn / TIC_ANGLE_UNIT), INT16_MAX), INT16_MIN);
+	cmd.look = (int16_t)max(min(lroundf(look / TIC_ANGLE_UNIT), INT16_MAX), INT16_MIN);
+	pending_turn = turn - cmd.turn * TIC_ANGLE_UNIT;
+	pending_look = look - cmd.look * TIC_ANGLE_UNIT;
+
+	if (is_button_pressed(KEY_EQUAL))
+		cmd.buttons |= TIC_BUTTON_CENTER_VIEW;
+
+	return cmd;
+}
+
+void engine_run_tic(const ticcmd* cmd)
+{
+	prev_cam = cam;
+
+	cam.yaw += cmd->turn * TIC_ANGLE_UNIT;
+	cam.pitch += cmd->look * TIC_ANGLE_UNIT;
+	if (cmd->buttons & TIC_BUTTON_CENTER_VIEW)
+		cam.pitch = 0.0f;
+	// Clamp the camera vertically
+	cam.pitch = max(-M_PI_2 + 0.05, min(M_PI_2 - 0.05, cam.pitch));
+
+	camera_update_direction_vectors(&cam);
+
+	vec3 forward = cam.forward;
+	vec3 right = cam.right;
+	forward.y = right.y = 0.0f;
+	forward = vec3_normalize(forward);
+	right = vec3_normalize(right);
+
+	cam.position = vec3_add(cam.position, vec3_scale(forward, cmd->forward));
+	cam.position = vec3_add(cam.position, vec3_scale(right, cmd->side));
+
+	vec2 position = { cam.position.x, cam.position.z };
+	snap_to_floor(position);
+
+	update_animation();
+	game_tic++;
+}
+
+int engine_get_tic()
+{
+	return game_tic;
+}
+
+void engine_set_view(vec2 position, float yaw, float pitch)
+{
+	cam.position = (vec3){ position.x, cam.position.y, position.y };
+	cam.yaw = yaw;
+	cam.pitch = pitch;
+
+	snap_to_floor(position);
+
+	camera_update_direction_vectors(&cam);
+	prev_cam = cam;
+}
+
+// Small moves stay in the same subsector, the BSP walk only runs when the player crosses out of it
+void snap_to_floor(vec2 position)
+{
+	cam_subsector = bsp_locate_from(position, cam_subsector);
+	int sector_index = bsp_get_sector(cam_subsector);
+	if (sector_index >= 0)
+		cam.position.y = m.sectors[sector_index].floor + player_height;
+}
+
+uint32_t engine_get_state_hash()
+{
+	// FNV-1a over the exact bits, any drift in the simulation changes it
+	uint32_t state[] = { 0, 0, 0, 0, 0, (uint32_t)game_tic };
+	memcpy(&state[0], &cam.position, sizeof(float) * 3);
+	memcpy(&state[3], &cam.yaw, sizeof(float));
+	memcpy(&state[4], &cam.pitch, sizeof(float));
+
+	uint32_t hash = 2166136261u;
+	const uint8_t* bytes = (const uint8_t*)state;
+	for (size_t i = 0; i < sizeof(state); i++)
+		hash = (hash ^ bytes[i]) * 16777619u;
+
+	return hash;
+}
+
+void engine_print_map_stats()
+{
+	if (software_renderer_is_enabled())
+	{
+		map_stats_print(current_mapname, NULL, 0);
+		return;
+	}
+
+	size_t flat_bytes = flat_texture_array_size(num_flats, renderer_is_true_color() ? &palettes[0] : NULL);
+	map_stats_print(current_mapname, &atlas, flat_bytes);
+}
+
+// The camera drawn is blended between the last two tics
+camera interpolate_camera()
+{
+	camera c = cam;
+	c.position = vec3_add(prev_cam.position, vec3_scale(vec3_sub(cam.position, prev_cam.position), tic_alpha));
+	c.yaw = prev_cam.yaw + (cam.yaw - prev_cam.yaw) * tic_alpha;
+	c.pitch = prev_cam.pitch + (cam.pitch - prev_cam.pitch) * tic_alpha;
+	camera_update_direction_vectors(&c);
+	return c;
 }
 
 void engine_render()
 {
-	mat4 view = mat4_look_at(cam.position, vec3_add(cam.position, cam.forward), cam.up);
+	render_cam = interpolate_camera();
+
+	if (software_renderer_is_enabled())
+	{
+		software_renderer_draw(&render_cam, FOV, palette_index);
+		return;
+	}
+
+	mat4 view = mat4_look_at(render_cam.position, vec3_add(render_cam.position, render_cam.forward), render_cam.up);
 	renderer_set_view(view);
 
 	renderer_set_palette_index(palette_index);
+	renderer_set_time((float)((game_tic + tic_alpha) / TIC_RATE));
+	anim_stream_tables();
+
+	mat4 view_projection = mat4_mult(view, projection);
+	frustum view_frustum = frustum_from_matrix(view_projection);
 
-	glStencilMask(0x00);
-	render_node(root_draw_node);
+	render_queue_begin();
+	render_node(root_draw_node, &view_frustum);
+	render_sky_mask(&view_frustum, view_projection);
+	render_queue_flush();
+}
 
-	glStencilMask(0xff);
-	for (stencil_node* node = stencil_ls.head; node != NULL; node = node->next)
+void load_textures(map* map)
+{
+	if (!residency_update(map))
+		return;
+
+	const flat_tex* flats = residency_get_flats(&num_flats);
+	const wall_tex* textures = residency_get_walls(&num_wall_textures);
+
+	free(wall_textures_info);
+	wall_textures_info = malloc(sizeof(wall_tex_info) * (num_wall_textures > 0 ? num_wall_textures : 1));
+	for (int i = 0; i < num_wall_textures; i++)
+		wall_textures_info[i] = (wall_tex_info){ textures[i].width, textures[i].height };
+
+	anim_init(flats, num_flats, textures, num_wall_textures);
+
+	// The CPU renderer samples the resident copies, nothing goes to the GPU
+	if (software_renderer_is_enabled())
+	{
+		software_renderer_set_textures(flats, num_flats, textures, num_wall_textures);
+		return;
+	}
+
+	const palette* expand_palette = renderer_is_true_color() ? &palettes[0] : NULL;
+
+	// The set grew, rebuild the GPU copies from the resident textures
+	if (flat_texture_array != 0)
+		glDeleteTextures(1, &flat_texture_array);
+	flat_texture_array = generate_flat_texture_array(flats, num_flats, expand_palette);
+
+	for (int i = 0; i < num_wall_textures; i++)
 	{
-		renderer_draw_mesh(&quad_mesh, SHADER_PLAIN, node->transformation);
+		if (strncmp_nocase(textures[i].name, "SKY1", 8) == 0)
+		{
+			if (sky_cubemap != 0)
+				glDeleteTextures(1, &sky_cubemap);
+			sky_cubemap = generate_texture_cubemap(&textures[i]);
+			renderer_set_sky_texture(sky_cubemap);
+		}
 	}
 
-	renderer_draw_sky();
+	if (atlas.texture != 0)
+		free_wall_atlas(&atlas);
+	generate_wall_atlas(textures, num_wall_textures, expand_palette, &atlas);
+
+	renderer_set_flat_texture(flat_texture_array);
+	renderer_set_wall_texture(atlas.texture, atlas.rects);
+	renderer_set_anim_tables(anim_get_flat_table(), anim_get_wall_table());
 }
 
-void render_node(draw_node* node)
+void render_node(draw_node* node, const frustum* view_frustum)
 {
-	if (node->mesh)
-		renderer_draw_mesh(node->mesh, SHADER_DEFAULT, mat4_identity());
+	if (node->mesh && frustum_test_aabb(view_frustum, node->mesh->min, node->mesh->max))
+	{
+		vec3 center = vec3_scale(vec3_add(node->mesh->min, node->mesh->max), 0.5f);
+		float depth = vec3_length(vec3_sub(center, render_cam.position)) / FAR_PLANE;
+
+		for (int i = 0; i < NUM_SURFACE_TYPES; i++)
+		{
+			if (node->surfaces[i].count == 0)
+				continue;
+
+			draw_item item = {
+				.mesh = node->mesh,
+				.first_index = node->surfaces[i].first,
+				.num_indices = node->surfaces[i].count,
+				.shader = surface_shaders[i],
+				.texture_set = TEXTURE_SET_WORLD
+			};
+			render_queue_submit(render_key(RENDER_PASS_WORLD, item.shader, TEXTURE_SET_WORLD, node->mesh->vao, depth), &item);
+		}
+	}
 	if (node->front)
-		render_node(node->front);
+		render_node(node->front, view_frustum);
 	if (node->back)
-		render_node(node->back);
+		render_node(node->back, view_frustum);
+}
+
+void render_sky_mask(const frustum* view_frustum, mat4 view_projection)
+{
+	// Screen-space bounds of the visible quads, the sky is scissored to them
+	vec2 min = { 1.0f, 1.0f }, max = { -1.0f, -1.0f };
+
+	if (stencil_quads.count == 0)
+		return;
+
+	// Sized for the worst case, visible transforms are written straight into the mapped buffer
+	stream_allocation alloc = stream_buffer_alloc(sizeof(mat4) * stencil_quads.count, sizeof(mat4));
+	if (alloc.data == NULL)
+	{
+		if (!has_sky_mask_overflowed)
+			fprintf(stderr, "Sky mask: no stream buffer space for %zu stencil quads, sky is not drawn\n", stencil_quads.count);
+		has_sky_mask_overflowed = true;
+		return;
+	}
+
+	mat4* instances = alloc.data;
+	size_t num_visible = 0;
+	for (size_t i = 0; i < stencil_quads.count; i++)
+	{
+		const stencil_quad* quad = &stencil_quads.data[i];
+		if (!frustum_test_aabb(view_frustum, quad->min, quad->max))
+			continue;
+
+		instances[num_visible++] = quad->transformation;
+
+		for (int j = 0; j < 8; j++)
+		{
+			vec4 corner = {
+				j & 1 ? quad->max.x : quad->min.x,
+				j & 2 ? quad->max.y : quad->min.y,
+				j & 4 ? quad->max.z : quad->min.z,
+				1.0f
+			};
+
+			vec4 clip = mat4_transform(view_projection, corner);
+			if (clip.w <= NEAR_PLANE)
+			{
+				// Box crosses the camera plane, fall back to the whole screen
+				min = (vec2){ -1.0f, -1.0f };
+				max = (vec2){ 1.0f, 1.0f };
+				continue;
+			}
+
+			min.x = fminf(min.x, clip.x / clip.w), min.y = fminf(min.y, clip.y / clip.w);
+			max.x = fmaxf(max.x, clip.x / clip.w), max.y = fmaxf(max.y, clip.y / clip.w);
+		}
+	}
+
+	if (num_visible == 0)
+		return;
+
+	draw_item item = {
+		.mesh = &quad_mesh,
+		.num_indices = quad_mesh.num_indices,
+		.shader = SHADER_SKY_MASK,
+		.texture_set = TEXTURE_SET_NONE,
+		.num_instances = num_visible,
+		.base_instance = alloc.offset / sizeof(mat4)
+	};
+	render_queue_submit(render_key(RENDER_PASS_SKY_MASK, SHADER_SKY_MASK, TEXTURE_SET_NONE, quad_mesh.vao, 0.0f), &item);
+
+	renderer_draw_sky(min, max);
 }
@@ -1,6 +1,40 @@
 #pragma once
 #include "wad_loader.h"
+#include "engine/anim.h"
+#include "math/vector.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TIC_SECONDS (1.0 / TIC_RATE)
+#define TIC_ANGLE_UNIT (6.28318530718f / 65536.0f) // Turns are whole 1/65536ths of a circle
+
+enum
+{
+	TIC_BUTTON_CENTER_VIEW = 1 << 0
+};
+
+// Everything the player did during one tic, the only input the simulation sees
+typedef struct ticcmd
+{
+	int8_t forward; // Map units this tic
+	int8_t side;
+	int16_t turn;   // TIC_ANGLE_UNITs
+	int16_t look;
+	uint8_t buttons;
+} ticcmd;
 
 void engine_init(wad* wad, const char* mapname);
-void engine_update(float dt);
+// Replaces the current map, the player starts at its first player 1 start
+bool engine_load_map(const char* mapname);
+// Runs as many fixed 35 Hz tics as dt covers, rendering interpolates between the last two
+void engine_update(double dt);
+void engine_run_tic(const ticcmd* cmd);
+int engine_get_tic();
+// Places the player directly, without interpolating from where it was
+void engine_set_view(vec2 position, float yaw, float pitch);
+// Hash of the player state, equal after the same ticcmds on the same map
+uint32_t engine_get_state_hash();
 void engine_render();
+// Geometry, BSP and memory figures of the current map, see map_stats.h
+void engine_print_map_stats();
@@ -0,0 +1,128 @@
+#include "map_stats.h"
+#include "engine/bsp.h"
+#include "engine/meshgen.h"
+#include "engine/residency.h"
+#include "engine/state.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#define MB (1024.0 * 1024.0)
+
+typedef struct bsp_stats
+{
+	int max_depth;
+	double leaf_depth_sum;
+	double balance_sum; // Smaller over larger subtree, in leaves
+	double min_balance;
+	size_t num_nodes; // Walked, differs from gl_m.num_nodes only on malformed nodes
+} bsp_stats;
+
+static size_t walk_bsp(uint16_t id, int depth, bsp_stats* stats);
+static void count_draw_nodes(const draw_node* node, size_t* num_nodes, size_t* num_meshes);
+
+static const char* surface_names[NUM_SURFACE_TYPES] = { "flat", "wall" };
+
+void map_stats_print(const char* mapname, const wall_atlas* atlas, size_t flat_texture_bytes)
+{
+	printf("Map %s\n", mapname);
+	printf("  vertices %zu, linedefs %zu, sidedefs %zu, sectors %zu, things %zu\n",
+		m.num_vertices, m.num_linedefs, m.num_sidedefs, m.num_sectors, m.num_things);
+	printf("  GL vertices %zu, segs %zu, subsectors %zu, nodes %zu\n",
+		gl_m.num_vertices, gl_m.num_segments, gl_m.num_subsectors, gl_m.num_nodes);
+
+	// A map of a single subsector has no nodes
+	if (gl_m.num_nodes > 0)
+	{
+		bsp_stats bsp = { .min_balance = 1.0 };
+		size_t num_leaves = walk_bsp(gl_m.num_nodes - 1, 0, &bsp);
+		printf("  BSP depth %d max, %.1f average leaf, %d for a balanced tree\n",
+			bsp.max_depth, bsp.leaf_depth_sum / (num_leaves > 0 ? num_leaves : 1), (int)ceil(log2((double)(num_leaves > 0 ? num_leaves : 1))));
+		printf("  BSP balance %.2f average, %.2f worst\n", bsp.balance_sum / bsp.num_nodes, bsp.min_balance);
+	}
+
+	meshgen_stats mesh_stats = meshgen_get_stats();
+	size_t num_vertices = 0, num_triangles = 0;
+	for (int i = 0; i < NUM_SURFACE_TYPES && atlas != NULL; i++)
+	{
+		printf("  %-5s %8zu triangles %8zu vertices\n", surface_names[i], mesh_stats.num_triangles[i], mesh_stats.num_vertices[i]);
+		num_vertices += mesh_stats.num_vertices[i];
+		num_triangles += mesh_stats.num_triangles[i];
+	}
+	if (atlas != NULL)
+		printf("  total %8zu triangles %8zu vertices in %zu meshes, %zu stencil quads\n",
+			num_triangles, num_vertices, mesh_stats.num_meshes, stencil_quads.count);
+	else
+		printf("  meshes: n/a (software renderer)\n");
+
+	size_t num_resident_flats, num_resident_walls;
+	residency_get_flats(&num_resident_flats);
+	const wall_tex* walls = residency_get_walls(&num_resident_walls);
+	size_t wall_texel_bytes = 0;
+	for (size_t i = 0; i < num_resident_walls; i++)
+		wall_texel_bytes += (size_t)walls[i].width * walls[i].height;
+
+	if (atlas != NULL)
+		printf("  textures: flats %.2f MB, wall atlas %.2f MB used of %.2f MB on %zu pages\n",
+			flat_texture_bytes / MB, atlas->used_bytes / MB, atlas->allocated_bytes / MB, atlas->num_pages);
+	else
+		printf("  textures: n/a (software renderer)\n");
+
+	size_t map_bytes = sizeof(vec2) * m.num_vertices + sizeof(linedef) * m.num_linedefs +
+		sizeof(sidedef) * m.num_sidedefs + sizeof(sector) * m.num_sectors + sizeof(thing) * m.num_things;
+	size_t gl_map_bytes = sizeof(vec2) * gl_m.num_vertices + sizeof(gl_segment) * gl_m.num_segments +
+		sizeof(gl_subsector) * gl_m.num_subsectors + sizeof(gl_node) * gl_m.num_nodes;
+	size_t num_draw_nodes = 0, num_meshes = 0;
+	count_draw_nodes(root_draw_node, &num_draw_nodes, &num_meshes);
+	size_t draw_tree_bytes = sizeof(draw_node) * num_draw_nodes + sizeof(mesh) * num_meshes;
+	size_t stencil_bytes = sizeof(stencil_quad) * stencil_quads.capacity;
+	size_t texture_bytes = sizeof(flat_tex) * num_resident_flats + sizeof(wall_tex) * num_resident_walls + wall_texel_bytes;
+	size_t buffer_bytes = sizeof(vertex) * num_vertices + sizeof(uint32_t) * 3 * num_triangles;
+
+	printf("  heap: map %.2f MB, GL map %.2f MB, point location %.2f MB, draw tree %.2f MB, stencil quads %.2f MB, resident textures %.2f MB\n",
+		map_bytes / MB, gl_map_bytes / MB, bsp_get_heap_bytes() / MB, draw_tree_bytes / MB, stencil_bytes / MB, texture_bytes / MB);
+	if (atlas != NULL)
+		printf("  GPU: mesh buffers %.2f MB, textures %.2f MB\n",
+			buffer_bytes / MB, (flat_texture_bytes + atlas->allocated_bytes) / MB);
+	else
+		printf("  GPU: n/a (software renderer)\n");
+}
+
+// Returns the number of leaves under id
+size_t walk_bsp(uint16_t id, int depth, bsp_stats* stats)
+{
+	if (id & 0x8000)
+	{
+		if (depth > stats->max_depth)
+			stats->max_depth = depth;
+		stats->leaf_depth_sum += depth;
+		return 1;
+	}
+	// Malformed GL nodes: out of range children count no leaves, as in bsp.c, and a valid tree
+	// is never deeper than its node count so a cycle stops there
+	if (id >= gl_m.num_nodes || (size_t)depth >= gl_m.num_nodes)
+		return 0;
+
+	const gl_node* node = &gl_m.nodes[id];
+	stats->num_nodes++;
+	size_t front = walk_bsp(node->front_child_id, depth + 1, stats);
+	size_t back = walk_bsp(node->back_child_id, depth + 1, stats);
+
+	double balance = front == back ? 1.0 : front < back ? (double)front / back : (double)back / front;
+	stats->balance_sum += balance;
+	if (balance < stats->min_balance)
+		stats->min_balance = balance;
+	return front + back;
+}
+
+void count_draw_nodes(const draw_node* node, size_t* num_nodes, size_t* num_meshes)
+{
+	if (node == NULL)
+		return;
+
+	(*num_nodes)++;
+	if (node->mesh)
+		(*num_meshes)++;
+	count_draw_nodes(node->front, num_nodes, num_meshes);
+	count_draw_nodes(node->back, num_nodes, num_meshes);
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "texture/wall_texture.h"
+
+#include <stddef.h>
+
+// Prints the loaded map's lump counts, the shape of its BSP tree, what generate_meshes made of it
+// per surface type, the texture memory it needs and the heap each subsystem holds for it.
+// atlas is NULL under the software renderer, which builds no meshes or GPU textures, and the
+// figures that only the GL renderer has print as n/a
+void map_stats_print(const char* mapname, const wall_atlas* atlas, size_t flat_texture_bytes);
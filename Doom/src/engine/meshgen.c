@@ -1,7 +1,6 @@
 #include "engine/meshgen.h"
 #include "engine/state.h"
 #include "engine/utilities.h"
-#include "engine/anim.h"
 #include "math/matrix.h"
 #include "math/vector.h"
 #include "darray.h"
@@ -12,11 +11,18 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <stdbool.h>
+#include <string.h>
 
 static void generate_node(draw_node** draw_node_ptr, size_t id);
+static void free_node(draw_node* node);
+static void count_surfaces(const vertexarray* vertices, const indexarray* indices);
+static uint8_t light_byte(int light_level);
+
+static meshgen_stats stats;
 
 void generate_meshes()
 {
+	stats = (meshgen_stats){ 0 };
 	max_sector_height = 0.0f;
 	for (int i = 0; i < m.num_sectors; i++)
 	{
@@ -41,24 +47,26 @@ void generate_meshes()
 void generate_node(draw_node** draw_node_ptr, size_t id)
 {
 	draw_node* d_node = malloc(sizeof(draw_node));
-	*d_node = (draw_node){ NULL, NULL, NULL };
+	*d_node = (draw_node){ 0 };
 	*draw_node_ptr = d_node;
 
 	if (id & 0x8000)
 	{
 		gl_subsector* subsector = &gl_m.subsectors[id & 0x7fff];
-		d_node->mesh = malloc(sizeof(mesh));
-
-		vertexarray vertices;
-		indexarray indices;
-		darray_init(vertices, 0);
-		darray_init(indices, 0);
 
 		sector* the_sector = NULL;
 		size_t n_vertices = subsector->num_segs;
 		if (n_vertices < 3)
 			return;
 
+		d_node->mesh = malloc(sizeof(mesh));
+
+		vertexarray vertices;
+		indexarray indices[NUM_SURFACE_TYPES];
+		darray_init(vertices, 0);
+		for (int i = 0; i < NUM_SURFACE_TYPES; i++)
+			darray_init(indices[i], 0);
+
 		vertex* floor_vertices = malloc(sizeof(vertex) * n_vertices);
 		vertex* ceil_vertices = malloc(sizeof(vertex) * n_vertices);
 
@@ -94,8 +102,7 @@ void generate_node(draw_node** draw_node_ptr, size_t id)
 
 			floor_vertices[j] = ceil_vertices[j] = (vertex){
 				.position = {start.x, 0.0f, start.y},
-				.tex_coords = {start.x / FLAT_TEXTURE_SIZE, -start.y / FLAT_TEXTURE_SIZE},
-				.texture_type = 1
+				.tex_coords = {start.x / FLAT_TEXTURE_SIZE, -start.y / FLAT_TEXTURE_SIZE}
 			};
 
 			if (segment->linedef == 0xffff)
@@ -104,7 +111,8 @@ void generate_node(draw_node** draw_node_ptr, size_t id)
 			linedef* linedef = &m.linedefs[segment->linedef];
 
 			sidedef* front_sidedef = &m.sidedefs[linedef->front_sidedef];
-			sidedef* back_sidedef = &m.sidedefs[linedef->back_sidedef];
+			// One-sided lines have no back, 0xffff is not an index
+			sidedef* back_sidedef = (linedef->flags & LINEDEF_FLAGS_TWO_SIDED) ? &m.sidedefs[linedef->back_sidedef] : front_sidedef;
 
 			if (segment->side)
 			{
@@ -149,28 +157,27 @@ void generate_node(draw_node** draw_node_ptr, size_t id)
 					float tx1 = x_off + w;
 					float ty1 = y_off;
 
-					vec2 max_coords = wall_max_coords[sidedef->lower];
-					tx0 *= max_coords.x, tx1 *= max_coords.x;
-					ty0 *= max_coords.y, ty1 *= max_coords.y;
+					tx0 *= tw, tx1 *= tw;
+					ty0 *= th, ty1 *= th;
 
-					float light = front_sector->light_level / 256.0f;
+					uint8_t light = light_byte(front_sector->light_level);
 					vertex v[] = {
-						{p0, {tx0, ty0}, sidedef->lower, 2, light, max_coords},
-						{p1, {tx1, ty0}, sidedef->lower, 2, light, max_coords},
-						{p2, {tx1, ty1}, sidedef->lower, 2, light, max_coords},
-						{p3, {tx0, ty1}, sidedef->lower, 2, light, max_coords}
+						{p0, {tx0, ty0}, sidedef->lower, light},
+						{p1, {tx1, ty0}, sidedef->lower, light},
+						{p2, {tx1, ty1}, sidedef->lower, light},
+						{p3, {tx0, ty1}, sidedef->lower, light}
 					};
 
 					start_index = vertices.count;
 					for (int i = 0; i < 4; i++)
 						darray_push(vertices, v[i]);
 
-					darray_push(indices, start_index + 0);
-					darray_push(indices, start_index + 1);
-					darray_push(indices, start_index + 3);
-					darray_push(indices, start_index + 1);
-					darray_push(indices, start_index + 2);
-					darray_push(indices, start_index + 3);
+					darray_push(indices[SURFACE_WALL], start_index + 0);
+					darray_push(indices[SURFACE_WALL], start_index + 1);
+					darray_push(indices[SURFACE_WALL], start_index + 3);
+					darray_push(indices[SURFACE_WALL], start_index + 1);
+					darray_push(indices[SURFACE_WALL], start_index + 2);
+					darray_push(indices[SURFACE_WALL], start_index + 3);
 				}
 
 				if (sidedef->upper >= 0 && front_sector->ceiling > back_sector->ceiling && !(front_sector->ceiling_tex == sky_flat && back_sector->ceiling_tex == sky_flat))
@@ -201,28 +208,27 @@ void generate_node(draw_node** draw_node_ptr, size_t id)
 					float tx1 = x_off + w;
 					float ty1 = y_off + h;
 
-					vec2 max_coords = wall_max_coords[sidedef->upper];
-					tx0 *= max_coords.x, tx1 *= max_coords.x;
-					ty0 *= max_coords.y, ty1 *= max_coords.y;
+					tx0 *= tw, tx1 *= tw;
+					ty0 *= th, ty1 *= th;
 
-					float light = front_sector->light_level / 256.0f;
+					uint8_t light = light_byte(front_sector->light_level);
 					vertex v[] = {
-						{p0, {tx0, ty0}, sidedef->upper, 2, light, max_coords},
-						{p1, {tx1, ty0}, sidedef->upper, 2, light, max_coords},
-						{p2, {tx1, ty1}, sidedef->upper, 2, light, max_coords},
-						{p3, {tx0, ty1}, sidedef->upper, 2, light, max_coords},
+						{p0, {tx0, ty0}, sidedef->upper, light},
+						{p1, {tx1, ty0}, sidedef->upper, light},
+						{p2, {tx1, ty1}, sidedef->upper, light},
+						{p3, {tx0, ty1}, sidedef->upper, light},
 					};
 
 					start_index = vertices.count;
 					for (int i = 0; i < 4; i++)
 						darray_push(vertices, v[i]);
 
-					darray_push(indices, start_index + 0);
-					darray_push(indices, start_index + 1);
-					darray_push(indices, start_index + 3);
-					darray_push(indices, start_index + 1);
-					darray_push(indices, start_index + 2);
-					darray_push(indices, start_index + 3);
+					darray_push(indices[SURFACE_WALL], start_index + 0);
+					darray_push(indices[SURFACE_WALL], start_index + 1);
+					darray_push(indices[SURFACE_WALL], start_index + 3);
+					darray_push(indices[SURFACE_WALL], start_index + 1);
+					darray_push(indices[SURFACE_WALL], start_index + 2);
+					darray_push(indices[SURFACE_WALL], start_index + 3);
 
 					if (sector->ceiling_tex == sky_flat)
 					{
@@ -248,42 +254,45 @@ void generate_node(draw_node** draw_node_ptr, size_t id)
 				const float width = sqrtf(x * x + y * y);
 				const float height = p3.y - p0.y;
 
-				float tw = wall_textures_info[sidedef->middle].width;
-				float th = wall_textures_info[sidedef->middle].height;
+				// Untextured walls are dropped here instead of being discarded per fragment
+				if (sidedef->middle >= 0)
+				{
+					float tw = wall_textures_info[sidedef->middle].width;
+					float th = wall_textures_info[sidedef->middle].height;
 
-				float w = width / tw;
-				float h = height / th;
-				float x_off = sidedef->x_off / tw;
-				float y_off = sidedef->y_off / th;
+					float w = width / tw;
+					float h = height / th;
+					float x_off = sidedef->x_off / tw;
+					float y_off = sidedef->y_off / th;
 
-				if (linedef->flags & LINEDEF_FLAGS_LOWER_UNPEGGED)
-					y_off -= h;
+					if (linedef->flags & LINEDEF_FLAGS_LOWER_UNPEGGED)
+						y_off -= h;
 
-				float tx0 = x_off, ty0 = y_off + h;
-				float tx1 = x_off + w, ty1 = y_off;
+					float tx0 = x_off, ty0 = y_off + h;
+					float tx1 = x_off + w, ty1 = y_off;
 
-				vec2 max_coords = wall_max_coords[sidedef->middle];
-				tx0 *= max_coords.x, tx1 *= max_coords.x;
-				ty0 *= max_coords.y, ty1 *= max_coords.y;
+					tx0 *= tw, tx1 *= tw;
+					ty0 *= th, ty1 *= th;
 
-				float light = sector->light_level / 256.0f;
-				vertex v[] = {
-					{p0, {tx0, ty0}, sidedef->middle, 2, light, max_coords},
-					{p1, {tx1, ty0}, sidedef->middle, 2, light, max_coords},
-					{p2, {tx1, ty1}, sidedef->middle, 2, light, max_coords},
-					{p3, {tx0, ty1}, sidedef->middle, 2, light, max_coords},
-				};
+					uint8_t light = light_byte(sector->light_level);
+					vertex v[] = {
+						{p0, {tx0, ty0}, sidedef->middle, light},
+						{p1, {tx1, ty0}, sidedef->middle, light},
+						{p2, {tx1, ty1}, sidedef->middle, light},
+						{p3, {tx0, ty1}, sidedef->middle, light},
+					};
 
-				start_index = vertices.count;
-				for (int i = 0; i < 4; i++)
-					darray_push(vertices, v[i]);
+					start_index = vertices.count;
+					for (int i = 0; i < 4; i++)
+						darray_push(vertices, v[i]);
 
-				darray_push(indices, start_index + 0);
-				darray_push(indices, start_index + 1);
-				darray_push(indices, start_index + 3);
-				darray_push(indices, start_index + 1);
-				darray_push(indices, start_index + 2);
-				darray_push(indices, start_index + 3);
+					darray_push(indices[SURFACE_WALL], start_index + 0);
+					darray_push(indices[SURFACE_WALL], start_index + 1);
+					darray_push(indices[SURFACE_WALL], start_index + 3);
+					darray_push(indices[SURFACE_WALL], start_index + 1);
+					darray_push(indices[SURFACE_WALL], start_index + 2);
+					darray_push(indices[SURFACE_WALL], start_index + 3);
+				}
 
 				if (sector->ceiling_tex == sky_flat)
 				{
@@ -303,48 +312,76 @@ void generate_node(draw_node** draw_node_ptr, size_t id)
 		for (int i = 0; i < n_vertices; i++)
 		{
 			floor_vertices[i].position.y = the_sector->floor;
-			floor_vertices[i].texture_index = floor_tex >= 0 && floor_tex < num_flats ? floor_tex : -1;
+			floor_vertices[i].texture_index = floor_tex;
 
 			ceil_vertices[i].position.y = the_sector->ceiling;
-			ceil_vertices[i].texture_index = ceil_tex >= 0 && ceil_tex < num_flats ? ceil_tex : -1;
+			ceil_vertices[i].texture_index = ceil_tex;
 
-			floor_vertices[i].light = ceil_vertices[i].light = the_sector->light_level / 256.0f;
+			floor_vertices[i].light = ceil_vertices[i].light = light_byte(the_sector->light_level);
 		}
 
-		start_index = vertices.count;
-		for (int i = 0; i < n_vertices; i++)
-			darray_push(vertices, floor_vertices[i]);
-
-		for (int i = 0; i < n_vertices; i++)
-			darray_push(vertices, ceil_vertices[i]);
+		// Untextured flats are dropped here instead of being discarded per fragment
+		bool has_floor = floor_tex >= 0 && floor_tex < num_flats;
+		bool has_ceil = ceil_tex >= 0 && ceil_tex < num_flats;
 
-		for (int i = 0; i < num_tex_anim_defs; i++)
+		if (has_floor)
 		{
-			if (floor_tex >= tex_anim_defs[i].start && floor_tex <= tex_anim_defs[i].end)
-				add_tex_anim(d_node->mesh, start_index, start_index + n_vertices, tex_anim_defs[i].start, tex_anim_defs[i].end);
+			start_index = vertices.count;
+			for (int i = 0; i < n_vertices; i++)
+				darray_push(vertices, floor_vertices[i]);
 
-			if (ceil_tex >= tex_anim_defs[i].start && ceil_tex <= tex_anim_defs[i].end)
-				add_tex_anim(d_node->mesh, start_index + n_vertices, start_index + 2 * n_vertices, tex_anim_defs[i].start, tex_anim_defs[i].end);
+			// Triangulation will form (n - 2) triangles so 3 * (n - 2) indices are required
+			for (int j = 0, k = 1; j < n_vertices - 2; j++, k++)
+			{
+				darray_push(indices[SURFACE_FLAT], start_index + 0);
+				darray_push(indices[SURFACE_FLAT], start_index + k + 1);
+				darray_push(indices[SURFACE_FLAT], start_index + k);
+			}
 		}
 
-		// Triangulation will form (n - 2) triangles so 2 * 3 * (n - 2) indices are required
-		for (int j = 0, k = 1; j < n_vertices - 2; j++, k++)
+		if (has_ceil)
 		{
-			darray_push(indices, start_index + 0);
-			darray_push(indices, start_index + k + 1);
-			darray_push(indices, start_index + k);
+			start_index = vertices.count;
+			for (int i = 0; i < n_vertices; i++)
+				darray_push(vertices, ceil_vertices[i]);
 
-			darray_push(indices, start_index + n_vertices);
-			darray_push(indices, start_index + n_vertices + k);
-			darray_push(indices, start_index + n_vertices + k + 1);
+			for (int j = 0, k = 1; j < n_vertices - 2; j++, k++)
+			{
+				darray_push(indices[SURFACE_FLAT], start_index + 0);
+				darray_push(indices[SURFACE_FLAT], start_index + k);
+				darray_push(indices[SURFACE_FLAT], start_index + k + 1);
+			}
 		}
 
 		free(floor_vertices);
 		free(ceil_vertices);
 
-		mesh_create(d_node->mesh, VERTEX_LAYOUT_FULL, vertices.count, vertices.data, indices.count, indices.data, true);
+		count_surfaces(&vertices, indices);
+
+		// One index buffer per subsector, grouped by surface type so every variant is a single range
+		indexarray all_indices;
+		darray_init(all_indices, 0);
+		for (int i = 0; i < NUM_SURFACE_TYPES; i++)
+		{
+			d_node->surfaces[i] = (index_range){ all_indices.count, indices[i].count };
+			for (size_t j = 0; j < indices[i].count; j++)
+				darray_push(all_indices, indices[i].data[j]);
+			darray_free(indices[i]);
+		}
+
+		if (all_indices.count == 0)
+		{
+			free(d_node->mesh);
+			d_node->mesh = NULL;
+		}
+		else
+		{
+			mesh_create(d_node->mesh, VERTEX_LAYOUT_FULL, vertices.count, vertices.data, all_indices.count, all_indices.data, false);
+			stats.num_meshes++;
+		}
+
 		darray_free(vertices);
-		darray_free(indices);
+		darray_free(all_indices);
 	}
 	else
 	{
@@ -353,3 +390,47 @@ void generate_node(draw_node** draw_node_ptr, size_t id)
 		generate_node(&d_node->back, node->back_child_id);
 	}
 }
+
+// Walls are separate quads (4 vertices, 6 indices) and every other vertex belongs to a flat
+void count_surfaces(const vertexarray* vertices, const indexarray* indices)
+{
+	size_t wall_vertices = indices[SURFACE_WALL].count / 6 * 4;
+	stats.num_vertices[SURFACE_WALL] += wall_vertices;
+	stats.num_vertices[SURFACE_FLAT] += vertices->count - wall_vertices;
+
+	for (int i = 0; i < NUM_SURFACE_TYPES; i++)
+		stats.num_triangles[i] += indices[i].count / 3;
+}
+
+meshgen_stats meshgen_get_stats()
+{
+	return stats;
+}
+
+void free_meshes()
+{
+	if (root_draw_node)
+		free_node(root_draw_node);
+	root_draw_node = NULL;
+	stencil_quads.count = 0;
+}
+
+void free_node(draw_node* node)
+{
+	if (node->front)
+		free_node(node->front);
+	if (node->back)
+		free_node(node->back);
+
+	if (node->mesh)
+	{
+		mesh_destroy(node->mesh);
+		free(node->mesh);
+	}
+	free(node);
+}
+
+uint8_t light_byte(int light_level)
+{
+	return (uint8_t)(light_level < 0 ? 0 : light_level > 255 ? 255 : light_level);
+}
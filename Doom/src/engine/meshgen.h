@@ -1,3 +1,15 @@
 #pragma once
+#include "engine/state.h"
+
+// What generate_meshes emitted for the current map
+typedef struct meshgen_stats
+{
+	size_t num_meshes;
+	size_t num_vertices[NUM_SURFACE_TYPES];
+	size_t num_triangles[NUM_SURFACE_TYPES];
+} meshgen_stats;
 
 void generate_meshes();
+// Releases the draw node tree, meshes and stencil quads of the current map
+void free_meshes();
+meshgen_stats meshgen_get_stats();
@@ -0,0 +1,189 @@
+#include "engine/residency.h"
+#include "engine/anim.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEXTURE_LUMP "TEXTURE1"
+
+static const wad* source;
+
+static wall_tex* texture_defs;
+static size_t num_texture_defs;
+static size_t num_flat_lumps;
+
+// Global index -> resident index, -1 when not resident
+static int* flat_map;
+static int* wall_map;
+static bool* flats_used;
+static bool* walls_used;
+
+static flat_tex* flats;
+static size_t num_flats;
+static wall_tex* walls;
+static size_t num_walls;
+
+static void mark_wall(int index);
+static void mark_flat(int index);
+static int remap(const int* table, size_t num, int index);
+
+void residency_init(const wad* wad)
+{
+	source = wad;
+
+	texture_defs = wad_read_texture_defs(&num_texture_defs, TEXTURE_LUMP, wad);
+	if (texture_defs == NULL)
+		num_texture_defs = 0;
+
+	int f_start = wad_find_lump("F_START", wad);
+	int f_end = wad_find_lump("F_END", wad);
+	num_flat_lumps = f_start >= 0 && f_end > f_start ? f_end - f_start - 1 : 0;
+
+	flat_map = malloc(sizeof(int) * (num_flat_lumps + 1));
+	flats_used = calloc(num_flat_lumps + 1, sizeof(bool));
+	for (size_t i = 0; i < num_flat_lumps; i++)
+		flat_map[i] = -1;
+
+	wall_map = malloc(sizeof(int) * (num_texture_defs + 1));
+	walls_used = calloc(num_texture_defs + 1, sizeof(bool));
+	for (size_t i = 0; i < num_texture_defs; i++)
+		wall_map[i] = -1;
+
+	flats = NULL, walls = NULL;
+	num_flats = num_walls = 0;
+}
+
+const wall_tex* residency_get_texture_defs(size_t* num)
+{
+	*num = num_texture_defs;
+	return texture_defs;
+}
+
+void residency_require_wall(const char* name)
+{
+	for (size_t i = 0; i < num_texture_defs; i++)
+	{
+		if (strncmp_nocase(texture_defs[i].name, name, 8) == 0)
+		{
+			mark_wall(i);
+			return;
+		}
+	}
+}
+
+void residency_require_flat(const char* name)
+{
+	int f_start = wad_find_lump("F_START", source);
+	int index = wad_find_lump(name, source);
+	if (f_start >= 0 && index > f_start)
+		mark_flat(index - f_start - 1);
+}
+
+bool residency_update(map* map)
+{
+	for (size_t i = 0; i < map->num_sidedefs; i++)
+	{
+		mark_wall(map->sidedefs[i].upper);
+		mark_wall(map->sidedefs[i].lower);
+		mark_wall(map->sidedefs[i].middle);
+	}
+
+	for (size_t i = 0; i < map->num_sectors; i++)
+	{
+		mark_flat(map->sectors[i].floor_tex);
+		mark_flat(map->sectors[i].ceiling_tex);
+	}
+
+	anim_expand_residency(source, flats_used, num_flat_lumps, texture_defs, walls_used, num_texture_defs);
+
+	// Appended in global order, so every animation range stays contiguous
+	size_t old_num_flats = num_flats, old_num_walls = num_walls;
+	for (size_t i = 0; i < num_flat_lumps; i++)
+	{
+		if (!flats_used[i] || flat_map[i] >= 0)
+			continue;
+
+		flats = realloc(flats, sizeof(flat_tex) * (num_flats + 1));
+		if (wad_read_flat(&flats[num_flats], i, source) != 0)
+		{
+			flats_used[i] = false;
+			continue;
+		}
+
+		flat_map[i] = num_flats++;
+	}
+
+	for (size_t i = 0; i < num_texture_defs; i++)
+	{
+		if (!walls_used[i] || wall_map[i] >= 0)
+			continue;
+
+		walls = realloc(walls, sizeof(wall_tex) * (num_walls + 1));
+		walls[num_walls] = texture_defs[i];
+		wad_compose_texture(&walls[num_walls], i, TEXTURE_LUMP, source);
+		wall_map[i] = num_walls++;
+	}
+
+	for (size_t i = 0; i < map->num_sidedefs; i++)
+	{
+		sidedef* side = &map->sidedefs[i];
+		side->upper = remap(wall_map, num_texture_defs, side->upper);
+		side->lower = remap(wall_map, num_texture_defs, side->lower);
+		side->middle = remap(wall_map, num_texture_defs, side->middle);
+	}
+
+	for (size_t i = 0; i < map->num_sectors; i++)
+	{
+		sector* sector = &map->sectors[i];
+		sector->floor_tex = remap(flat_map, num_flat_lumps, sector->floor_tex);
+		sector->ceiling_tex = remap(flat_map, num_flat_lumps, sector->ceiling_tex);
+	}
+
+	printf("Residency: %zu/%zu flats, %zu/%zu wall textures\n", num_flats, num_flat_lumps, num_walls, num_texture_defs);
+
+	return num_flats != old_num_flats || num_walls != old_num_walls;
+}
+
+int residency_get_flat(int global_index)
+{
+	return remap(flat_map, num_flat_lumps, global_index);
+}
+
+int residency_get_wall(int global_index)
+{
+	return remap(wall_map, num_texture_defs, global_index);
+}
+
+const flat_tex* residency_get_flats(size_t* num)
+{
+	*num = num_flats;
+	return flats;
+}
+
+const wall_tex* residency_get_walls(size_t* num)
+{
+	*num = num_walls;
+	return walls;
+}
+
+void mark_wall(int index)
+{
+	if (index >= 0 && index < num_texture_defs)
+		walls_used[index] = true;
+}
+
+void mark_flat(int index)
+{
+	if (index >= 0 && index < num_flat_lumps)
+		flats_used[index] = true;
+}
+
+int remap(const int* table, size_t num, int index)
+{
+	if (index < 0 || index >= num)
+		return -1;
+
+	return table[index];
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "map.h"
+#include "wad_loader.h"
+#include "texture/flat_texture.h"
+#include "texture/wall_texture.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Tracks which flats and wall textures are resident on the GPU. Maps are read with global
+// indices (TEXTURE1 order, lumps after F_START) and remapped to a compact resident numbering.
+// The set only ever grows, new entries are appended so resident indices stay stable
+void residency_init(const wad* wad);
+
+// Texture definitions (names and sizes, no texel data) for wad_read_map
+const wall_tex* residency_get_texture_defs(size_t* num);
+
+// Keeps a wall texture resident even if no sidedef uses it (e.g. the sky)
+void residency_require_wall(const char* name);
+void residency_require_flat(const char* name);
+
+// Composes everything the map and its animations need, then remaps the map in place.
+// Returns true when the resident set grew and the GPU copies must be rebuilt
+bool residency_update(map* map);
+
+int residency_get_flat(int global_index);
+int residency_get_wall(int global_index);
+
+const flat_tex* residency_get_flats(size_t* num);
+const wall_tex* residency_get_walls(size_t* num);
@@ -1,28 +1,40 @@
 #pragma once
 
 #include "math/matrix.h"
+#include "darray.h"
 #include "gl_map.h"
 #include "map.h"
 #include "mesh.h"
 
+enum surface_type
+{
+	SURFACE_FLAT,
+	SURFACE_WALL,
+
+	NUM_SURFACE_TYPES
+};
+
+typedef struct index_range
+{
+	size_t first;
+	size_t count;
+} index_range;
+
 typedef struct draw_node
 {
 	mesh* mesh;
+	index_range surfaces[NUM_SURFACE_TYPES];
 	struct draw_node* front;
 	struct draw_node* back;
 } draw_node;
 
-typedef struct stencil_node
+typedef struct stencil_quad
 {
 	mat4 transformation;
-	struct stencil_node* next;
-} stencil_node;
+	vec3 min, max;
+} stencil_quad;
 
-typedef struct stencil_quad_list
-{
-	stencil_node* head;
-	stencil_node* tail;
-} stencil_list;
+typedef darray(stencil_quad) stencil_quad_array;
 
 typedef struct wall_tex_info
 {
@@ -30,19 +42,10 @@ typedef struct wall_tex_info
 	int height;
 } wall_tex_info;
 
-typedef struct tex_anim_def
-{
-	const char* end_name;
-	const char* start_name;
-	int start;
-	int end;
-} tex_anim_def;
-
 extern size_t num_flats;
 extern size_t num_wall_textures;
 extern size_t num_palettes;
 extern wall_tex_info* wall_textures_info;
-extern vec2* wall_max_coords;
 
 extern map m;
 extern gl_map gl_m;
@@ -51,7 +54,4 @@ extern float max_sector_height;
 extern int sky_flat;
 
 extern draw_node* root_draw_node;
-extern stencil_list stencil_ls;
-
-extern tex_anim_def tex_anim_defs[];
-extern size_t num_tex_anim_defs;
+extern stencil_quad_array stencil_quads;
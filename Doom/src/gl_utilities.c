@@ -1,14 +1,10 @@
 #include "gl_utilities.h"
 
-#include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
-GLuint compile_shader(GLenum type, const char* src)
+bool check_shader(GLuint shader)
 {
-	GLuint shader = glCreateShader(type);
-	glShaderSource(shader, 1, &src, NULL);
-	glCompileShader(shader);
-
 	GLint success;
 	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
 	if (!success)
@@ -18,21 +14,11 @@ GLuint compile_shader(GLenum type, const char* src)
 		fprintf(stderr, "Failed to compile shader!\nInfo:\n%s\n", infolog);
 	}
 
-	return shader;
+	return success;
 }
 
-GLuint link_shader(size_t num_shaders, ...)
+bool check_program(GLuint program)
 {
-	GLuint program = glCreateProgram();
-
-	va_list va;
-	va_start(va, num_shaders);
-	for (size_t i = 0; i < num_shaders; i++)
-		glAttachShader(program, va_arg(va, GLuint));
-	va_end(va);
-
-	glLinkProgram(program);
-
 	GLint success;
 	glGetProgramiv(program, GL_LINK_STATUS, &success);
 	if (!success)
@@ -42,23 +28,19 @@ GLuint link_shader(size_t num_shaders, ...)
 		fprintf(stderr, "Failed to link shader!\nInfo:\n%s\n", infolog);
 	}
 
-	return program;
+	return success;
 }
 
-GLuint generate_texture(uint16_t width, uint16_t height, uint8_t* data)
+bool has_gl_extension(const char* name)
 {
-	GLuint tex_id;
-	glGenTextures(1, &tex_id);
-	glBindTexture(GL_TEXTURE_2D, tex_id);
+	GLint num_extensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, data);
+	for (GLint i = 0; i < num_extensions; i++)
+	{
+		if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+			return true;
+	}
 
-	return tex_id;
+	return false;
 }
@@ -1,10 +1,10 @@
 #pragma once
 #include "glad/glad.h"
 
-#include <stddef.h>
-#include <stdint.h>
+#include <stdbool.h>
 
-GLuint compile_shader(GLenum type, const char* src);
-GLuint link_shader(size_t num_shaders, ...);
+// Query and report compile/link status, these block until the driver is done
+bool check_shader(GLuint shader);
+bool check_program(GLuint program);
 
-GLuint generate_texture(uint16_t width, uint16_t height, uint8_t* data);
+bool has_gl_extension(const char* name);
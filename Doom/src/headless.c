@@ -0,0 +1,137 @@
+#include "headless.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+
+static EGLDisplay get_surfaceless_display();
+
+bool headless_context_create()
+{
+	display = get_surfaceless_display();
+	if (display == EGL_NO_DISPLAY)
+	{
+		fprintf(stderr, "Failed to get an EGL display\n");
+		return false;
+	}
+
+	EGLint major, minor;
+	if (!eglInitialize(display, &major, &minor))
+	{
+		fprintf(stderr, "Failed to initialize EGL (0x%x)\n", eglGetError());
+		return false;
+	}
+
+	const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+	if (extensions == NULL || strstr(extensions, "EGL_KHR_surfaceless_context") == NULL)
+	{
+		fprintf(stderr, "EGL %d.%d does not support surfaceless contexts\n", major, minor);
+		headless_context_destroy();
+		return false;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		fprintf(stderr, "EGL does not support desktop OpenGL\n");
+		headless_context_destroy();
+		return false;
+	}
+
+	// Any config will do since nothing is ever drawn to an EGL surface
+	const EGLint config_attributes[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_NONE
+	};
+	EGLConfig config = NULL;
+	EGLint num_configs = 0;
+	if (!eglChooseConfig(display, config_attributes, &config, 1, &num_configs) || num_configs == 0)
+		config = NULL; // EGL_NO_CONFIG_KHR
+
+	const EGLint context_attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 5,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+	if (context == EGL_NO_CONTEXT)
+	{
+		fprintf(stderr, "Failed to create an OpenGL 4.5 core context (0x%x)\n", eglGetError());
+		headless_context_destroy();
+		return false;
+	}
+
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		fprintf(stderr, "Failed to make the headless context current (0x%x)\n", eglGetError());
+		headless_context_destroy();
+		return false;
+	}
+
+	printf("Headless EGL %d.%d context\n", major, minor);
+	return true;
+}
+
+void headless_context_destroy()
+{
+	if (display == EGL_NO_DISPLAY)
+		return;
+
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (context != EGL_NO_CONTEXT)
+		eglDestroyContext(display, context);
+	eglTerminate(display);
+
+	context = EGL_NO_CONTEXT;
+	display = EGL_NO_DISPLAY;
+}
+
+void* headless_get_proc_address(const char* name)
+{
+	return (void*)eglGetProcAddress(name);
+}
+
+EGLDisplay get_surfaceless_display()
+{
+	// The platform display entry point is an extension before EGL 1.5
+	const char* client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (client_extensions != NULL && strstr(client_extensions, "EGL_MESA_platform_surfaceless") != NULL)
+	{
+		PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (get_platform_display != NULL)
+		{
+			EGLDisplay surfaceless = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+			if (surfaceless != EGL_NO_DISPLAY)
+				return surfaceless;
+		}
+	}
+
+	return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+#else
+
+bool headless_context_create()
+{
+	fprintf(stderr, "Headless rendering needs EGL, which is only wired up on Linux\n");
+	return false;
+}
+
+void headless_context_destroy()
+{
+}
+
+void* headless_get_proc_address(const char* name)
+{
+	return NULL;
+}
+
+#endif
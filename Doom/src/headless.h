@@ -0,0 +1,11 @@
+#pragma once
+#include <stdbool.h>
+
+// OpenGL 4.5 core context without any window or display, through EGL on Mesa's surfaceless
+// platform (works with llvmpipe). There is no default framebuffer, render into a render target
+// registered with render_target_set_default(). Linux only, elsewhere creation just fails
+bool headless_context_create();
+void headless_context_destroy();
+
+// Loader for gladLoadGLLoader()
+void* headless_get_proc_address(const char* name);
@@ -99,11 +99,17 @@ vec2 get_mouse_position()
 
 int is_mouse_captured()
 {
+	if (window == NULL)
+		return 0;
+
 	return glfwGetInputMode(window, GLFW_CURSOR) == GLFW_CURSOR_DISABLED ? 1 : 0;
 }
 
 void set_mouse_captured(int is_captured)
 {
+	if (window == NULL)
+		return;
+
 	glfwSetInputMode(window, GLFW_CURSOR, is_captured ? GLFW_CURSOR_DISABLED : GLFW_CURSOR_NORMAL);
 }
 
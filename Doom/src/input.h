@@ -82,6 +82,7 @@ vec2 get_mouse_position();
 int is_mouse_captured();
 void set_mouse_captured(int is_captured);
 
+// window may be NULL when running headless, every button then stays released
 void input_init(GLFWwindow* window);
 void input_tick();
 
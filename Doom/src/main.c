@@ -1,59 +1,106 @@
 #include "engine/engine.h"
+#include "engine/demo.h"
+#include "args.h"
+#include "benchmark.h"
+#include "capture.h"
+#include "headless.h"
 #include "renderer.h"
+#include "render_queue.h"
+#include "render_target.h"
 #include "wad_loader.h"
 #include "input.h"
+#include "program_cache.h"
 #include "gl_utilities.h"
+#include "thread.h"
+#include "thread_pool.h"
+#include "timer.h"
+#include "software/software_renderer.h"
 
 #include "glad/glad.h"
 #include "GLFW/glfw3.h"
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #define WIDTH 1920
 #define HEIGHT 1080
+#define DEFAULT_HEADLESS_FRAMES 1000
+
+static GLFWwindow* create_window(int width, int height, bool has_gl);
+static void run_demo_fast();
 
 int main(int argc, char** argv)
 {
-	if (glfwInit() != GLFW_TRUE)
+	args_init(argc, argv);
+
+	// -headless renders into an offscreen target for -frames frames, -width/-height size either mode.
+	// -software draws on the CPU and never creates a GL context
+	bool is_headless = args_has("-headless");
+	bool has_gl = !args_has("-software");
+	int width = args_get("-width") != NULL ? atoi(args_get("-width")) : WIDTH;
+	int height = args_get("-height") != NULL ? atoi(args_get("-height")) : HEIGHT;
+	if (width <= 0 || height <= 0)
 	{
-		fprintf(stderr, "Failed to initialize GLFW\n");
+		fprintf(stderr, "Invalid resolution %dx%d\n", width, height);
 		return -1;
 	}
 
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	// -threads N sizes the pool the software renderer and batched point location share,
+	// N defaults to the number of logical processors
+	const char* threads = args_get("-threads");
+	thread_pool_init(threads != NULL ? atoi(threads) : thread_get_num_cores());
 
-	GLFWmonitor* monitor = glfwGetPrimaryMonitor();
-	const GLFWvidmode* mode = glfwGetVideoMode(monitor);
-	int xPos = (mode->width - WIDTH) / 2;
-	int yPos = (mode->height - HEIGHT) / 2;
+	// -playdemo <file> replays a recording on the map it was made on, -record <file> saves one,
+	// -nodraw runs playback without rendering as fast as the simulation allows
+	char mapname[DEMO_MAPNAME_SIZE] = "E1M1";
+	if (args_get("-map") != NULL)
+		snprintf(mapname, sizeof(mapname), "%s", args_get("-map"));
+	if (args_get("-playdemo") != NULL && !demo_play(args_get("-playdemo"), mapname))
+		return -1;
+	if (args_get("-record") != NULL && !demo_record(args_get("-record"), mapname))
+		return -1;
 
-	GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "Doom1993-Remake", NULL, NULL);
-	glfwSetWindowPos(window, xPos, yPos);
-	glfwMakeContextCurrent(window);
+	// Headless playback stops with the demo instead of after a fixed number of frames
+	int default_frames = is_headless && !demo_is_playing() ? DEFAULT_HEADLESS_FRAMES : 0;
+	int max_frames = args_get("-frames") != NULL ? atoi(args_get("-frames")) : default_frames;
 
-	// V-Sync
-	glfwSwapInterval(0);
+	GLFWwindow* window = NULL;
+	if (is_headless && has_gl)
+	{
+		if (!headless_context_create())
+			return -1;
 
-	if (!gladLoadGLLoader(glfwGetProcAddress))
+		if (!gladLoadGLLoader(headless_get_proc_address))
+		{
+			fprintf(stderr, "Failed to initialize Glad\n");
+			return -1;
+		}
+		program_cache_load(headless_get_proc_address);
+	}
+	else if (!is_headless)
 	{
-		fprintf(stderr, "Failed to initialize Glad\n");
-		return -1;
+		window = create_window(width, height, has_gl);
+		if (window == NULL)
+			return -1;
 	}
 
-	printf("OpenGL Info:\n");
-	printf("\tVendor: %s\n", glGetString(GL_VENDOR));
-	printf("\tRenderer: %s\n", glGetString(GL_RENDERER));
-	printf("\tVersion: %s\n", glGetString(GL_VERSION));
+	if (has_gl)
+	{
+		printf("OpenGL Info:\n");
+		printf("\tVendor: %s\n", glGetString(GL_VENDOR));
+		printf("\tRenderer: %s\n", glGetString(GL_RENDERER));
+		printf("\tVersion: %s\n", glGetString(GL_VERSION));
+	}
 
 	// Input handling
 	input_init(window);
-	glfwSetKeyCallback(window, input_key_callback);
-	glfwSetMouseButtonCallback(window, input_mouse_button_callback);
-	glfwSetCursorPosCallback(window, input_mouse_position_callback);
+	if (window != NULL)
+	{
+		glfwSetKeyCallback(window, input_key_callback);
+		glfwSetMouseButtonCallback(window, input_mouse_button_callback);
+		glfwSetCursorPosCallback(window, input_mouse_position_callback);
+	}
 
 	wad wad;
 	if (wad_load_from_file("res/doom1.wad", &wad) != 0)
@@ -62,29 +109,191 @@ int main(int argc, char** argv)
 		return -1;
 	}
 
-	renderer_init(WIDTH, HEIGHT);
-	engine_init(&wad, "E1M1");
+	// -file <pwad> adds maps (e.g. from MapGen) on top of the IWAD, -map <name> picks the one to start on
+	if (args_get("-file") != NULL && wad_add_file(args_get("-file"), &wad) != 0)
+	{
+		fprintf(stderr, "Failed to load PWAD file '%s'\n", args_get("-file"));
+		return -1;
+	}
+
+	// Without a window everything ends up in this target instead
+	render_target output = { 0 };
+	if (is_headless && has_gl)
+	{
+		if (render_target_create(&output, width, height, GL_RGBA8, GL_NEAREST) != 0)
+			return -1;
+
+		render_target_set_default(&output);
+		render_target_bind_default(width, height);
+	}
+
+	if (has_gl)
+		renderer_init(width, height);
+	software_renderer_init(window, width, height);
+	capture_init(width, height);
+	engine_init(&wad, mapname);
+	benchmark_init(&wad, width, height);
+	if (benchmark_is_enabled())
+		max_frames = 0;
+
+	// -mapstats reports on the map and exits without drawing
+	bool is_running = true;
+	if (args_has("-mapstats"))
+	{
+		engine_print_map_stats();
+		is_running = false;
+	}
+
+	if (demo_is_playing() && args_has("-nodraw"))
+		run_demo_fast();
 
-	char title[128];
-	float last = 0.0f;
-	while (!glfwWindowShouldClose(window))
+	char title[256];
+	double start = timer_now();
+	double last = start;
+	int num_frames = 0;
+	while (is_running && (window == NULL || !glfwWindowShouldClose(window)))
 	{
-		float now = glfwGetTime();
-		float delta = now - last;
+		if (max_frames > 0 && num_frames >= max_frames)
+			break;
+		if (demo_is_finished())
+			break;
+		if (benchmark_is_enabled() && !benchmark_begin_frame())
+			break;
+
+		double now = timer_now();
+		double delta = now - last;
 		last = now;
 
 		input_tick();
-		glfwPollEvents();
-		snprintf(title, 128, "Doom1993-Remake | %.0f fps", 1.0f / delta);
-		glfwSetWindowTitle(window, title);
+		if (window != NULL)
+			glfwPollEvents();
+		// The benchmark places the camera itself
+		if (!benchmark_is_enabled())
+			engine_update(delta);
+
+		if (software_renderer_is_enabled())
+		{
+			engine_render();
+			software_renderer_present();
 
-		engine_update(delta);
+			software_stats stats = software_renderer_get_stats();
+			snprintf(title, 256, "Doom1993-Remake | software | %.0f fps | %d threads | %.1f fps per core",
+				1.0f / delta, stats.num_threads, stats.fps_per_core);
+		}
+		else
+		{
+			renderer_begin_frame();
+			engine_render();
+			renderer_end_frame();
 
-		renderer_clear();
-		engine_render();
-		glfwSwapBuffers(window);
+			render_stats stats = render_queue_get_stats();
+			snprintf(title, 256, "Doom1993-Remake | %.0f fps | %.0f%% res | %zu draws | %zu state changes (%zu avoided)",
+				1.0f / delta, renderer_get_resolution_scale() * 100.0f, stats.num_draws, stats.num_state_changes, stats.num_state_changes_avoided);
+		}
+
+		benchmark_end_frame();
+		capture_frame();
+
+		if (window != NULL)
+		{
+			if (has_gl)
+				glfwSwapBuffers(window);
+			glfwSetWindowTitle(window, title);
+		}
+		else if (has_gl)
+		{
+			glFlush();
+		}
+
+		num_frames++;
+	}
+
+	if (is_headless && num_frames > 0)
+	{
+		// Count the tail of queued GPU work in the total
+		if (has_gl)
+			glFinish();
+		double elapsed = timer_now() - start;
+		printf("Headless: %d frames at %dx%d in %.2f s, %.1f fps\n", num_frames, width, height, elapsed, num_frames / elapsed);
+	}
+
+	demo_end(engine_get_state_hash());
+	benchmark_shutdown();
+	capture_shutdown();
+	software_renderer_shutdown();
+	thread_pool_shutdown();
+	if (is_headless && has_gl)
+	{
+		render_target_destroy(&output);
+		headless_context_destroy();
+	}
+	else if (!is_headless)
+	{
+		glfwTerminate();
 	}
 
-	glfwTerminate();
 	return 0;
-}
\ No newline at end of file
+}
+
+GLFWwindow* create_window(int width, int height, bool has_gl)
+{
+	if (glfwInit() != GLFW_TRUE)
+	{
+		fprintf(stderr, "Failed to initialize GLFW\n");
+		return NULL;
+	}
+
+	if (has_gl)
+	{
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	}
+	else
+	{
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+	}
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+
+	GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+	const GLFWvidmode* mode = glfwGetVideoMode(monitor);
+	int xPos = (mode->width - width) / 2;
+	int yPos = (mode->height - height) / 2;
+
+	GLFWwindow* window = glfwCreateWindow(width, height, "Doom1993-Remake", NULL, NULL);
+	glfwSetWindowPos(window, xPos, yPos);
+	if (!has_gl)
+		return window;
+
+	glfwMakeContextCurrent(window);
+
+	// V-Sync
+	glfwSwapInterval(0);
+
+	if (!gladLoadGLLoader(glfwGetProcAddress))
+	{
+		fprintf(stderr, "Failed to initialize Glad\n");
+		return NULL;
+	}
+	program_cache_load((GLADloadproc)glfwGetProcAddress);
+
+	return window;
+}
+
+void run_demo_fast()
+{
+	double start = timer_now();
+	int first_tic = engine_get_tic();
+
+	ticcmd cmd;
+	while (demo_read_tic(&cmd))
+	{
+		demo_write_tic(&cmd);
+		engine_run_tic(&cmd);
+	}
+
+	double elapsed = timer_now() - start;
+	int num_tics = engine_get_tic() - first_tic;
+	printf("Demo: %d tics in %.3f s, %.0f tics/s, %.1fx real time\n",
+		num_tics, elapsed, num_tics / elapsed, num_tics / elapsed / TIC_RATE);
+}
@@ -0,0 +1,48 @@
+#include "math/frustum.h"
+
+#include <math.h>
+
+frustum frustum_from_matrix(mat4 vp)
+{
+	// mat4 stores columns, so row r of the matrix is (m[0][r], m[1][r], m[2][r], m[3][r])
+	vec4 rows[4];
+	for (int r = 0; r < 4; r++)
+		rows[r] = (vec4){ vp.m[0][r], vp.m[1][r], vp.m[2][r], vp.m[3][r] };
+
+	frustum f;
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			f.planes[i * 2 + 0].v[j] = rows[3].v[j] + rows[i].v[j];
+			f.planes[i * 2 + 1].v[j] = rows[3].v[j] - rows[i].v[j];
+		}
+	}
+
+	for (int i = 0; i < 6; i++)
+	{
+		float length = sqrtf(f.planes[i].x * f.planes[i].x + f.planes[i].y * f.planes[i].y + f.planes[i].z * f.planes[i].z);
+		for (int j = 0; j < 4; j++)
+			f.planes[i].v[j] /= length;
+	}
+
+	return f;
+}
+
+bool frustum_test_aabb(const frustum* f, vec3 min, vec3 max)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		const vec4* p = &f->planes[i];
+
+		// Corner of the box furthest along the plane normal
+		float x = p->x >= 0.0f ? max.x : min.x;
+		float y = p->y >= 0.0f ? max.y : min.y;
+		float z = p->z >= 0.0f ? max.z : min.z;
+
+		if (p->x * x + p->y * y + p->z * z + p->w < 0.0f)
+			return false;
+	}
+
+	return true;
+}
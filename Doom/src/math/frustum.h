@@ -0,0 +1,14 @@
+#pragma once
+#include "math/matrix.h"
+#include "math/vector.h"
+
+#include <stdbool.h>
+
+typedef struct frustum
+{
+	// Plane equations (a, b, c, d) with normals pointing inside
+	vec4 planes[6];
+} frustum;
+
+frustum frustum_from_matrix(mat4 view_projection);
+bool frustum_test_aabb(const frustum* f, vec3 min, vec3 max);
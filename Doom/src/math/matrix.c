@@ -27,6 +27,15 @@ mat4 mat4_mult(mat4 m1, mat4 m2)
 	return result;
 }
 
+vec4 mat4_transform(mat4 m, vec4 v)
+{
+	vec4 result;
+	for (int i = 0; i < 4; i++)
+		result.v[i] = m.m[0][i] * v.x + m.m[1][i] * v.y + m.m[2][i] * v.z + m.m[3][i] * v.w;
+
+	return result;
+}
+
 mat4 mat4_translate(vec3 translation)
 {
 	mat4 mat = mat4_identity();
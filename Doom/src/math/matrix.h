@@ -17,6 +17,7 @@ typedef union mat4
 
 mat4 mat4_identity();
 mat4 mat4_mult(mat4 m1, mat4 m2);
+vec4 mat4_transform(mat4 m, vec4 v);
 
 mat4 mat4_translate(vec3 translation);
 mat4 mat4_scale(vec3 scale);
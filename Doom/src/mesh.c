@@ -1,6 +1,11 @@
 #include "mesh.h"
+#include "math/matrix.h"
 #include "math/vector.h"
 
+#include <math.h>
+
+static void compute_bounds(mesh* mesh, size_t stride, size_t num_vertices, const void* vertices);
+
 void mesh_create(mesh* mesh, vertex_layout vertex_layout, size_t num_vertices, const void* vertices, size_t num_indices, const uint32_t* indices, bool is_dynamic)
 {
 	mesh->num_indices = num_indices;
@@ -16,12 +21,14 @@ void mesh_create(mesh* mesh, vertex_layout vertex_layout, size_t num_vertices, c
 	{
 	case VERTEX_LAYOUT_PLAIN:
 		glBufferData(GL_ARRAY_BUFFER, sizeof(vec3) * num_vertices, vertices, is_dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+		compute_bounds(mesh, sizeof(vec3), num_vertices, vertices);
 
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
 		glEnableVertexAttribArray(0);
 		break;
 	case VERTEX_LAYOUT_FULL:
 		glBufferData(GL_ARRAY_BUFFER, sizeof(vertex) * num_vertices, vertices, is_dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+		compute_bounds(mesh, sizeof(vertex), num_vertices, vertices);
 
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, position));
 		glEnableVertexAttribArray(0);
@@ -29,20 +36,54 @@ void mesh_create(mesh* mesh, vertex_layout vertex_layout, size_t num_vertices, c
 		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, tex_coords));
 		glEnableVertexAttribArray(1);
 		
-		glVertexAttribIPointer(2, 1, GL_INT, sizeof(vertex), (void*)offsetof(vertex, texture_index));
+		glVertexAttribIPointer(2, 1, GL_SHORT, sizeof(vertex), (void*)offsetof(vertex, texture_index));
 		glEnableVertexAttribArray(2);
 
-		glVertexAttribIPointer(3, 1, GL_INT, sizeof(vertex), (void*)offsetof(vertex, texture_type));
+		glVertexAttribIPointer(3, 1, GL_UNSIGNED_BYTE, sizeof(vertex), (void*)offsetof(vertex, light));
 		glEnableVertexAttribArray(3);
-
-		glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, light));
-		glEnableVertexAttribArray(4);
-
-		glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, max_coords));
-		glEnableVertexAttribArray(5);
 		break;
 	}
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ebo);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * num_indices, indices, GL_STATIC_DRAW);
 }
+
+void mesh_add_instance_transforms(mesh* mesh, GLuint buffer)
+{
+	glBindVertexArray(mesh->vao);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	for (int i = 0; i < 4; i++)
+	{
+		glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (void*)(sizeof(vec4) * i));
+		glVertexAttribDivisor(1 + i, 1);
+		glEnableVertexAttribArray(1 + i);
+	}
+}
+
+void mesh_destroy(mesh* mesh)
+{
+	glDeleteVertexArrays(1, &mesh->vao);
+	glDeleteBuffers(1, &mesh->vbo);
+	glDeleteBuffers(1, &mesh->ebo);
+	*mesh = (struct mesh){ 0 };
+}
+
+// Both layouts start with the vertex position
+void compute_bounds(mesh* mesh, size_t stride, size_t num_vertices, const void* vertices)
+{
+	mesh->min = (vec3){ INFINITY, INFINITY, INFINITY };
+	mesh->max = (vec3){ -INFINITY, -INFINITY, -INFINITY };
+
+	for (size_t i = 0; i < num_vertices; i++)
+	{
+		const vec3* position = (const vec3*)((const char*)vertices + i * stride);
+		for (int j = 0; j < 3; j++)
+		{
+			if (position->v[j] < mesh->min.v[j])
+				mesh->min.v[j] = position->v[j];
+			if (position->v[j] > mesh->max.v[j])
+				mesh->max.v[j] = position->v[j];
+		}
+	}
+}
@@ -11,16 +11,17 @@ typedef struct mesh
 {
 	GLuint vao, vbo, ebo;
 	size_t num_indices;
+
+	// Object-space bounding box
+	vec3 min, max;
 } mesh;
 
 typedef struct vertex
 {
 	vec3 position;
 	vec2 tex_coords;
-	int texture_index;
-	int texture_type;
-	float light;
-	vec2 max_coords;
+	int16_t texture_index;
+	uint8_t light; // Sector light level, the shaders turn it into a COLORMAP row
 } vertex;
 
 typedef enum vertex_layout
@@ -30,6 +31,9 @@ typedef enum vertex_layout
 } vertex_layout;
 
 void mesh_create(mesh* mesh, vertex_layout vertex_layout, size_t num_vertices, const void* vertices, size_t num_indices, const uint32_t* indices, bool is_dynamic);
+// Sources a per-instance mat4 from buffer at locations 1-4, only valid for VERTEX_LAYOUT_PLAIN
+void mesh_add_instance_transforms(mesh* mesh, GLuint buffer);
+void mesh_destroy(mesh* mesh);
 
 typedef darray(vertex) vertexarray;
 typedef darray(uint32_t) indexarray;
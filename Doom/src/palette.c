@@ -1,17 +1,102 @@
 #include "palette.h"
 
-GLuint palettes_generate_texture(const palette* palettes, size_t num)
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+GLuint palettes_generate_colormap_texture(const palette* palettes, size_t num, const colormap* colormaps, size_t num_colormaps)
 {
+	// The shaders fetch every light row, a short COLORMAP gets the fallback like the software renderer
+	if (num_colormaps < NUM_LIGHT_COLORMAPS)
+		colormaps = NULL;
+	size_t num_rows = colormaps != NULL ? num_colormaps : NUM_LIGHT_COLORMAPS;
+	uint8_t* data = malloc(NUM_COLORS * 3 * num_rows * num);
+
+	for (size_t p = 0; p < num; p++)
+	{
+		for (size_t row = 0; row < num_rows; row++)
+		{
+			uint8_t* dst = &data[((p * num_rows) + row) * NUM_COLORS * 3];
+			for (int i = 0; i < NUM_COLORS; i++)
+			{
+				if (colormaps != NULL)
+				{
+					memcpy(&dst[i * 3], &palettes[p].colors[colormaps[row].indices[i] * 3], 3);
+					continue;
+				}
+
+				for (int c = 0; c < 3; c++)
+					dst[i * 3 + c] = palettes[p].colors[i * 3 + c] * (NUM_LIGHT_COLORMAPS - row) / NUM_LIGHT_COLORMAPS;
+			}
+		}
+	}
+
 	GLuint tex_id;
 	glGenTextures(1, &tex_id);
-	glBindTexture(GL_TEXTURE_1D_ARRAY, tex_id);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, tex_id);
 
-	glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-	glTexImage2D(GL_TEXTURE_1D_ARRAY, 0, GL_RGB8, NUM_COLORS, num, 0, GL_RGB, GL_UNSIGNED_BYTE, palettes);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGB8, NUM_COLORS, num_rows, num);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, NUM_COLORS, num_rows, num, GL_RGB, GL_UNSIGNED_BYTE, data);
 
+	free(data);
 	return tex_id;
 }
+
+void palette_expand(const palette* palette, const uint8_t* indices, uint8_t* rgba, size_t num)
+{
+	for (size_t i = 0; i < num; i++)
+	{
+		const uint8_t* color = &palette->colors[indices[i] * 3];
+		rgba[i * 4 + 0] = color[0];
+		rgba[i * 4 + 1] = color[1];
+		rgba[i * 4 + 2] = color[2];
+		rgba[i * 4 + 3] = indices[i] == 247 ? 0 : 255;
+	}
+}
+
+vec4 palette_compute_tint(const palette* base, const palette* palette)
+{
+	// Fit y = slope * x + offset per channel, the palettes are linear blends towards one color
+	float slope = 0.0f;
+	float offsets[3];
+	for (int c = 0; c < 3; c++)
+	{
+		float mean_x = 0.0f, mean_y = 0.0f;
+		for (int i = 0; i < NUM_COLORS; i++)
+		{
+			mean_x += base->colors[i * 3 + c] / 255.0f;
+			mean_y += palette->colors[i * 3 + c] / 255.0f;
+		}
+		mean_x /= NUM_COLORS, mean_y /= NUM_COLORS;
+
+		float covariance = 0.0f, variance = 0.0f;
+		for (int i = 0; i < NUM_COLORS; i++)
+		{
+			float dx = base->colors[i * 3 + c] / 255.0f - mean_x;
+			float dy = palette->colors[i * 3 + c] / 255.0f - mean_y;
+			covariance += dx * dy;
+			variance += dx * dx;
+		}
+
+		float channel_slope = variance > 0.0f ? covariance / variance : 1.0f;
+		slope += channel_slope / 3.0f;
+		offsets[c] = mean_y - channel_slope * mean_x;
+	}
+
+	float amount = fminf(fmaxf(1.0f - slope, 0.0f), 1.0f);
+	if (amount < 0.001f)
+		return (vec4){ 0.0f, 0.0f, 0.0f, 0.0f };
+
+	return (vec4){
+		fminf(fmaxf(offsets[0] / amount, 0.0f), 1.0f),
+		fminf(fmaxf(offsets[1] / amount, 0.0f), 1.0f),
+		fminf(fmaxf(offsets[2] / amount, 0.0f), 1.0f),
+		amount
+	};
+}
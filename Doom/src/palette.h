@@ -1,13 +1,30 @@
 #pragma once
 #include "glad/glad.h"
+#include "math/vector.h"
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define NUM_COLORS 256
+#define NUM_LIGHT_COLORMAPS 32 // Rows 0 (full bright) to 31 (darkest), the rest are special effects
 
 typedef struct palette
 {
 	uint8_t colors[NUM_COLORS * 3];
 } palette;
 
-GLuint palettes_generate_texture(const palette* palettes, size_t num);
+typedef struct colormap
+{
+	uint8_t indices[NUM_COLORS];
+} colormap;
+
+// COLORMAP pre-multiplied with every palette, an RGB8 2D array indexed by (color, colormap row, palette).
+// Without colormaps, or with fewer than NUM_LIGHT_COLORMAPS rows, they fall back to linearly darkened palettes
+GLuint palettes_generate_colormap_texture(const palette* palettes, size_t num, const colormap* colormaps, size_t num_colormaps);
+
+// Expands indexed texels to RGBA8, index 247 is treated as transparent
+void palette_expand(const palette* palette, const uint8_t* indices, uint8_t* rgba, size_t num);
+
+// Least-squares fit of palette as mix(base, tint.rgb, tint.a), used to apply
+// palette effects to already expanded true-color textures
+vec4 palette_compute_tint(const palette* base, const palette* palette);
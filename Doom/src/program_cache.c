@@ -0,0 +1,263 @@
+#include "program_cache.h"
+#include "gl_utilities.h"
+#include "thread.h"
+#include "timer.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define make_directory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define make_directory(path) mkdir(path, 0755)
+#endif
+
+// GL_KHR_parallel_shader_compile and GL_ARB_parallel_shader_compile share the token
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSPROC)(GLuint count);
+
+#define CACHE_MAGIC 0x48435047 // "GPCH"
+
+typedef struct cache_header
+{
+	uint32_t magic;
+	uint32_t format;
+	uint32_t length;
+} cache_header;
+
+static program_cache_stats stats;
+static PFNGLMAXSHADERCOMPILERTHREADSPROC max_compiler_threads;
+
+static uint64_t hash_string(uint64_t hash, const char* str);
+static uint64_t hash_program(const program_desc* desc, uint64_t driver_hash);
+static void cache_path(char* path, size_t size, uint64_t hash);
+static bool load_program(GLuint program, uint64_t hash);
+static void store_program(GLuint program, uint64_t hash);
+
+void program_cache_load(GLADloadproc load)
+{
+	max_compiler_threads = (PFNGLMAXSHADERCOMPILERTHREADSPROC)load("glMaxShaderCompilerThreadsKHR");
+	if (max_compiler_threads == NULL)
+		max_compiler_threads = (PFNGLMAXSHADERCOMPILERTHREADSPROC)load("glMaxShaderCompilerThreadsARB");
+}
+
+void program_cache_build(size_t num_programs, const program_desc* descs, GLuint* programs)
+{
+	double start = timer_now();
+	stats = (program_cache_stats){ 0 };
+
+	GLint num_formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+	bool use_cache = num_formats > 0;
+
+	uint64_t driver_hash = 14695981039346656037ull;
+	driver_hash = hash_string(driver_hash, (const char*)glGetString(GL_VENDOR));
+	driver_hash = hash_string(driver_hash, (const char*)glGetString(GL_RENDERER));
+	driver_hash = hash_string(driver_hash, (const char*)glGetString(GL_VERSION));
+
+	uint64_t* hashes = malloc(sizeof(uint64_t) * num_programs);
+	bool* is_pending = malloc(sizeof(bool) * num_programs);
+	GLuint* stages = malloc(sizeof(GLuint) * num_programs * 2);
+
+	for (size_t i = 0; i < num_programs; i++)
+	{
+		hashes[i] = hash_program(&descs[i], driver_hash);
+		programs[i] = glCreateProgram();
+		is_pending[i] = !use_cache || !load_program(programs[i], hashes[i]);
+
+		if (is_pending[i])
+			stats.num_misses++;
+		else
+			stats.num_hits++;
+	}
+
+	bool is_parallel = has_gl_extension("GL_KHR_parallel_shader_compile") || has_gl_extension("GL_ARB_parallel_shader_compile");
+	if (is_parallel && max_compiler_threads != NULL)
+		max_compiler_threads(thread_get_num_cores());
+
+	// Issue every compile and link first, nothing below blocks on the driver until the status queries
+	for (size_t i = 0; i < num_programs; i++)
+	{
+		if (!is_pending[i])
+			continue;
+
+		GLuint vertex = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(vertex, descs[i].num_vert_sources, descs[i].vert_sources, NULL);
+		glCompileShader(vertex);
+
+		GLuint fragment = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(fragment, descs[i].num_frag_sources, descs[i].frag_sources, NULL);
+		glCompileShader(fragment);
+
+		stages[i * 2 + 0] = vertex;
+		stages[i * 2 + 1] = fragment;
+	}
+
+	for (size_t i = 0; i < num_programs; i++)
+	{
+		if (!is_pending[i])
+			continue;
+
+		if (use_cache)
+			glProgramParameteri(programs[i], GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+		glAttachShader(programs[i], stages[i * 2 + 0]);
+		glAttachShader(programs[i], stages[i * 2 + 1]);
+		glLinkProgram(programs[i]);
+	}
+
+	if (stats.num_misses > 0 && is_parallel)
+	{
+		// Let the driver threads finish before querying the blocking link status
+		bool is_done = false;
+		while (!is_done)
+		{
+			is_done = true;
+			for (size_t i = 0; i < num_programs && is_done; i++)
+			{
+				if (!is_pending[i])
+					continue;
+
+				GLint completed = GL_TRUE;
+				glGetProgramiv(programs[i], GL_COMPLETION_STATUS_KHR, &completed);
+				is_done = completed == GL_TRUE;
+			}
+
+			if (!is_done)
+				thread_yield();
+		}
+	}
+
+	for (size_t i = 0; i < num_programs; i++)
+	{
+		if (!is_pending[i])
+			continue;
+
+		check_shader(stages[i * 2 + 0]);
+		check_shader(stages[i * 2 + 1]);
+		bool is_linked = check_program(programs[i]);
+
+		glDetachShader(programs[i], stages[i * 2 + 0]);
+		glDetachShader(programs[i], stages[i * 2 + 1]);
+		glDeleteShader(stages[i * 2 + 0]);
+		glDeleteShader(stages[i * 2 + 1]);
+
+		if (is_linked && use_cache)
+			store_program(programs[i], hashes[i]);
+	}
+
+	free(hashes);
+	free(is_pending);
+	free(stages);
+
+	stats.seconds = timer_now() - start;
+}
+
+program_cache_stats program_cache_get_stats()
+{
+	return stats;
+}
+
+// 64-bit FNV-1a
+uint64_t hash_string(uint64_t hash, const char* str)
+{
+	for (; str && *str; str++)
+	{
+		hash ^= (uint8_t)*str;
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+uint64_t hash_program(const program_desc* desc, uint64_t driver_hash)
+{
+	uint64_t hash = driver_hash;
+	for (size_t i = 0; i < desc->num_vert_sources; i++)
+		hash = hash_string(hash, desc->vert_sources[i]);
+
+	// Separator so that moving text between stages changes the key
+	hash = hash_string(hash, "\x01");
+
+	for (size_t i = 0; i < desc->num_frag_sources; i++)
+		hash = hash_string(hash, desc->frag_sources[i]);
+
+	return hash;
+}
+
+void cache_path(char* path, size_t size, uint64_t hash)
+{
+	snprintf(path, size, "%s/%016llx.bin", PROGRAM_CACHE_DIRECTORY, (unsigned long long)hash);
+}
+
+bool load_program(GLuint program, uint64_t hash)
+{
+	char path[256];
+	cache_path(path, sizeof(path), hash);
+
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+		return false;
+
+	cache_header header;
+	bool is_loaded = false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	// The length comes from disk, a truncated or corrupt file must not size the allocation
+	if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == CACHE_MAGIC &&
+		size >= 0 && header.length > 0 && header.length <= (unsigned long)size - sizeof(header))
+	{
+		void* binary = malloc(header.length);
+		if (fread(binary, header.length, 1, file) == 1)
+		{
+			glProgramBinary(program, header.format, binary, header.length);
+
+			// A driver update can reject the binary, fall back to compiling then
+			GLint success;
+			glGetProgramiv(program, GL_LINK_STATUS, &success);
+			is_loaded = success == GL_TRUE;
+		}
+		free(binary);
+	}
+
+	fclose(file);
+	return is_loaded;
+}
+
+void store_program(GLuint program, uint64_t hash)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	void* binary = malloc(length);
+	GLenum format;
+	glGetProgramBinary(program, length, NULL, &format, binary);
+
+	make_directory(PROGRAM_CACHE_DIRECTORY);
+
+	char path[256];
+	cache_path(path, sizeof(path), hash);
+
+	FILE* file = fopen(path, "wb");
+	if (file != NULL)
+	{
+		cache_header header = { CACHE_MAGIC, format, length };
+		fwrite(&header, sizeof(header), 1, file);
+		fwrite(binary, length, 1, file);
+		fclose(file);
+	}
+
+	free(binary);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "glad/glad.h"
+
+#include <stddef.h>
+
+#define PROGRAM_MAX_SOURCES 8
+#define PROGRAM_CACHE_DIRECTORY "shader_cache"
+
+typedef struct program_desc
+{
+	size_t num_vert_sources;
+	const char* vert_sources[PROGRAM_MAX_SOURCES];
+
+	size_t num_frag_sources;
+	const char* frag_sources[PROGRAM_MAX_SOURCES];
+} program_desc;
+
+typedef struct program_cache_stats
+{
+	size_t num_hits;
+	size_t num_misses;
+	double seconds;
+} program_cache_stats;
+
+// Resolves the parallel compile entry points that glad was not generated with, call after glad is loaded
+void program_cache_load(GLADloadproc load);
+
+// Builds every program in one batch. Programs whose binary is cached on disk (keyed by a hash
+// of their sources and the driver string) are loaded directly, the remaining ones are all
+// compiled and linked before any status is queried so the driver can work on them in parallel
+void program_cache_build(size_t num_programs, const program_desc* descs, GLuint* programs);
+
+program_cache_stats program_cache_get_stats();
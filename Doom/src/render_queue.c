@@ -0,0 +1,144 @@
+#include "render_queue.h"
+#include "renderer.h"
+#include "darray.h"
+
+#include "glad/glad.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct sort_entry
+{
+	uint64_t key;
+	size_t item;
+} sort_entry;
+
+static darray(draw_item) items;
+static darray(sort_entry) entries;
+static render_stats stats;
+
+static int compare_entries(const void* a, const void* b);
+
+uint64_t render_key(int pass, int shader, int texture_set, GLuint vao, float depth)
+{
+	if (depth < 0.0f) depth = 0.0f;
+	if (depth > 1.0f) depth = 1.0f;
+
+	uint64_t depth_bits = (uint64_t)(depth * ((1 << RENDER_KEY_DEPTH_BITS) - 1));
+
+	return ((uint64_t)(pass & 0xf) << RENDER_KEY_PASS_SHIFT) |
+		((uint64_t)(shader & 0xff) << RENDER_KEY_SHADER_SHIFT) |
+		((uint64_t)(texture_set & 0xff) << RENDER_KEY_TEXTURE_SET_SHIFT) |
+		((uint64_t)(vao & 0xfffff) << RENDER_KEY_VAO_SHIFT) |
+		depth_bits;
+}
+
+void render_queue_init()
+{
+	darray_init(items, 256);
+	darray_init(entries, 256);
+}
+
+void render_queue_begin()
+{
+	items.count = 0;
+	entries.count = 0;
+}
+
+void render_queue_submit(uint64_t key, const draw_item* item)
+{
+	sort_entry entry = { key, items.count };
+
+	darray_push(items, *item);
+	darray_push(entries, entry);
+}
+
+void render_queue_flush()
+{
+	qsort(entries.data, entries.count, sizeof(sort_entry), compare_entries);
+
+	stats = (render_stats){ 0 };
+
+	int pass = -1, shader = -1, texture_set = -1;
+	GLuint vao = 0;
+	// Model matrix last uploaded to each program, lives as long as the submitted item
+	const mat4* models[NUM_SHADERS];
+	bool has_model[NUM_SHADERS] = { false };
+
+	for (size_t i = 0; i < entries.count; i++)
+	{
+		const draw_item* item = &items.data[entries.data[i].item];
+		int item_pass = (int)(entries.data[i].key >> RENDER_KEY_PASS_SHIFT);
+
+		if (item_pass != pass)
+		{
+			pass = item_pass;
+			renderer_begin_pass(pass);
+			stats.num_state_changes++;
+		}
+		else
+			stats.num_state_changes_avoided++;
+
+		if (item->shader != shader)
+		{
+			shader = item->shader;
+			renderer_bind_shader(shader);
+			stats.num_state_changes++;
+		}
+		else
+			stats.num_state_changes_avoided++;
+
+		if (item->texture_set != texture_set)
+		{
+			texture_set = item->texture_set;
+			renderer_bind_texture_set(texture_set);
+			stats.num_state_changes++;
+		}
+		else
+			stats.num_state_changes_avoided++;
+
+		if (!has_model[shader] || models[shader] != item->model)
+		{
+			models[shader] = item->model;
+			has_model[shader] = true;
+			renderer_set_model(shader, item->model);
+			stats.num_state_changes++;
+		}
+		else
+			stats.num_state_changes_avoided++;
+
+		if (item->mesh->vao != vao)
+		{
+			// The element buffer binding is part of the VAO state
+			vao = item->mesh->vao;
+			glBindVertexArray(vao);
+			stats.num_state_changes++;
+		}
+		else
+			stats.num_state_changes_avoided++;
+
+		const void* offset = (const void*)(sizeof(uint32_t) * item->first_index);
+		if (item->num_instances > 0)
+			glDrawElementsInstancedBaseInstance(GL_TRIANGLES, item->num_indices, GL_UNSIGNED_INT, offset, item->num_instances, item->base_instance);
+		else
+			glDrawElements(GL_TRIANGLES, item->num_indices, GL_UNSIGNED_INT, offset);
+		stats.num_draws++;
+		stats.num_triangles += item->num_indices / 3 * (item->num_instances > 0 ? item->num_instances : 1);
+	}
+
+	if (pass != -1)
+		renderer_end_passes();
+}
+
+render_stats render_queue_get_stats()
+{
+	return stats;
+}
+
+int compare_entries(const void* a, const void* b)
+{
+	uint64_t key_a = ((const sort_entry*)a)->key;
+	uint64_t key_b = ((const sort_entry*)b)->key;
+
+	return key_a < key_b ? -1 : key_a > key_b;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "mesh.h"
+#include "math/matrix.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Sort key layout, most significant first:
+// | pass (4) | shader (8) | texture set (8) | vao (20) | depth (24) |
+#define RENDER_KEY_PASS_SHIFT 60
+#define RENDER_KEY_SHADER_SHIFT 52
+#define RENDER_KEY_TEXTURE_SET_SHIFT 44
+#define RENDER_KEY_VAO_SHIFT 24
+#define RENDER_KEY_DEPTH_BITS 24
+
+typedef struct draw_item
+{
+	const mesh* mesh;
+	size_t first_index;
+	size_t num_indices;
+	int shader;
+	int texture_set;
+	const mat4* model; // NULL means identity
+	size_t num_instances; // 0 for a plain draw
+	size_t base_instance;
+} draw_item;
+
+typedef struct render_stats
+{
+	size_t num_draws;
+	size_t num_triangles;
+	size_t num_state_changes;
+	size_t num_state_changes_avoided;
+} render_stats;
+
+// depth is normalized to [0, 1], items within the same state are drawn front to back
+uint64_t render_key(int pass, int shader, int texture_set, GLuint vao, float depth);
+
+void render_queue_init();
+void render_queue_begin();
+void render_queue_submit(uint64_t key, const draw_item* item);
+void render_queue_flush();
+
+render_stats render_queue_get_stats();
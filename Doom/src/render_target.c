@@ -0,0 +1,76 @@
+#include "render_target.h"
+
+#include <stdio.h>
+
+static GLuint default_fbo;
+
+int render_target_create(render_target* target, int width, int height, GLenum format, GLenum filter)
+{
+	target->width = width;
+	target->height = height;
+	target->format = format;
+
+	glGenTextures(1, &target->color);
+	glBindTexture(GL_TEXTURE_2D, target->color);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+
+	glGenRenderbuffers(1, &target->depth_stencil);
+	glBindRenderbuffer(GL_RENDERBUFFER, target->depth_stencil);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+	glGenFramebuffers(1, &target->fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->color, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target->depth_stencil);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, default_fbo);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		fprintf(stderr, "Render target %dx%d is incomplete (0x%x)\n", width, height, status);
+		render_target_destroy(target);
+		return 1;
+	}
+
+	return 0;
+}
+
+void render_target_destroy(render_target* target)
+{
+	glDeleteFramebuffers(1, &target->fbo);
+	glDeleteRenderbuffers(1, &target->depth_stencil);
+	glDeleteTextures(1, &target->color);
+	*target = (render_target){ 0 };
+}
+
+void render_target_bind(const render_target* target)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+	glViewport(0, 0, target->width, target->height);
+}
+
+void render_target_bind_region(const render_target* target, int width, int height)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+	glViewport(0, 0, width, height);
+}
+
+void render_target_bind_default(int width, int height)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, default_fbo);
+	glViewport(0, 0, width, height);
+}
+
+void render_target_set_default(const render_target* target)
+{
+	default_fbo = target != NULL ? target->fbo : 0;
+}
+
+GLuint render_target_get_default()
+{
+	return default_fbo;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "glad/glad.h"
+
+// Offscreen framebuffer with one color attachment and a depth/stencil renderbuffer
+typedef struct render_target
+{
+	GLuint fbo, color, depth_stencil;
+	int width, height;
+	GLenum format;
+} render_target;
+
+// filter applies to sampling the color texture, e.g. for upscaling
+int render_target_create(render_target* target, int width, int height, GLenum format, GLenum filter);
+void render_target_destroy(render_target* target);
+
+void render_target_bind(const render_target* target);
+// Renders into the lower-left width x height region only, for dynamic resolution
+void render_target_bind_region(const render_target* target, int width, int height);
+// Binds the window framebuffer back with the given viewport
+void render_target_bind_default(int width, int height);
+
+// Stands in for the window framebuffer when there is none (headless), NULL restores it
+void render_target_set_default(const render_target* target);
+GLuint render_target_get_default();
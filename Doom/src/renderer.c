@@ -1,120 +1,273 @@
 #include "renderer.h"
+#include "render_queue.h"
+#include "args.h"
 #include "gl_utilities.h"
+#include "program_cache.h"
+#include "render_target.h"
+#include "dynamic_resolution.h"
+#include "stream_buffer.h"
+#include "texture/texture_upload.h"
+#include "utils.h"
 #include "math/matrix.h"
 
 #include "glad/glad.h"
 
 #include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 static void init_skybox();
 static void init_shaders();
-
-const char* vert_src =
-	"#version 330 core\n"
+static void init_frame_uniforms();
+static void flush_frame_uniforms();
+static void resolve_indexed();
+static void upscale_scene();
+
+const char* version_src = "#version 330 core\n";
+
+const char* frame_block_src =
+	"layout (std140) uniform FrameData {\n"
+	"  mat4 u_view;\n"
+	"  mat4 u_projection;\n"
+	"  mat4 u_view_projection;\n"
+	"  int u_palette_index;\n"
+	"  float u_time;\n"
+	"  vec4 u_palette_tint;\n"
+	"};\n";
+
+const char* world_vert_src =
 	"layout (location = 0) in vec3 pos;\n"
 	"layout (location = 1) in vec2 texCoords;\n"
 	"layout (location = 2) in int texIndex;\n"
-	"layout (location = 3) in int texType;\n"
-	"layout (location = 4) in float light;\n"
-	"layout (location = 5) in vec2 maxTexCoords;\n"
+	"layout (location = 3) in int light;\n"
 	"out vec2 TexCoords;\n"
 	"flat out int TexIndex;\n"
-	"flat out int TexType;\n"
-	"flat out vec2 MaxTexCoords;"
-	"out float Light;\n"
+	"flat out int Light;\n"
+	"out float ViewDepth;\n"
 	"uniform mat4 u_model;\n"
-	"uniform mat4 u_view;\n"
-	"uniform mat4 u_projection;\n"
+	"#ifdef TEX_ANIM_TABLE\n"
+	"uniform isamplerBuffer TEX_ANIM_TABLE;\n"
+	"#endif\n"
+	"#ifdef WALL_ATLAS\n"
+	"flat out ivec3 AtlasOrigin;\n"
+	"flat out vec2 AtlasSize;\n"
+	"uniform isamplerBuffer u_wall_rects;\n"
+	"#endif\n"
 	"void main() {\n"
-	"  gl_Position = u_projection * u_view * u_model * vec4(pos, 1.0);\n"
+	"  gl_Position = u_view_projection * u_model * vec4(pos, 1.0);\n"
+	"  ViewDepth = gl_Position.w;\n"
+	"#ifdef TEX_ANIM_TABLE\n"
+	"  TexIndex = texelFetch(TEX_ANIM_TABLE, texIndex).r;\n"
+	"#else\n"
 	"  TexIndex = texIndex;\n"
-	"  TexType = texType;\n"
+	"#endif\n"
 	"  TexCoords = texCoords;\n"
 	"  Light = light;\n"
-	"  MaxTexCoords = maxTexCoords;\n"
+	"#ifdef WALL_ATLAS\n"
+	"  ivec4 rect = texelFetch(u_wall_rects, TexIndex);\n"
+	"  AtlasOrigin = rect.xyz;\n"
+	"  AtlasSize = vec2(rect.w & 0xffff, rect.w >> 16);\n"
+	"#endif\n"
 	"}\n";
 
-const char* frag_src =
-	"#version 330 core\n"
+// Shared by every fragment shader. light_row() is vanilla's zlight table: sector light picks the
+// starting COLORMAP row, which darkens with view depth. With an indexed target the palette index
+// and row are written as they are and the resolve pass does the colormap lookup once per pixel
+const char* fragment_output_src =
+	"int light_row(int light, float depth) {\n"
+	"  int start = (15 - (light >> 4)) * 4;\n"
+	"  return clamp(start - int(1280.0 / max(depth, 1.0)), 0, 31);\n"
+	"}\n"
+	"#ifdef INDEXED_TARGET\n"
+	"out uvec2 fragIndex;\n"
+	"void write_index(int index, int row) {\n"
+	"  fragIndex = uvec2(index, row);\n"
+	"}\n"
+	"#else\n"
+	"out vec4 fragColor;\n"
+	"uniform sampler2DArray u_colormap;\n"
+	"void write_index(int index, int row) {\n"
+	"  fragColor = vec4(texelFetch(u_colormap, ivec3(index, row, u_palette_index), 0).rgb, 1.0);\n"
+	"}\n"
+	"#endif\n";
+
+// World fragment variants, one program per surface type so none of them branches or discards
+const char* flat_frag_src =
 	"in vec2 TexCoords;\n"
 	"flat in int TexIndex;\n"
-	"flat in int TexType;\n"
-	"flat in vec2 MaxTexCoords;"
-	"in float Light;\n"
-	"out vec4 fragColor;\n"
+	"flat in int Light;\n"
+	"in float ViewDepth;\n"
+	"#ifdef TRUE_COLOR\n"
+	"uniform sampler2DArray u_flat_tex;\n"
+	"#else\n"
 	"uniform usampler2DArray u_flat_tex;\n"
+	"#endif\n"
+	"void main() {\n"
+	"#ifdef TRUE_COLOR\n"
+	"  vec3 color = texture(u_flat_tex, vec3(TexCoords, TexIndex)).rgb;\n"
+	"  color = mix(color, u_palette_tint.rgb, u_palette_tint.a);\n"
+	"  fragColor = vec4(color * (1.0 - float(light_row(Light, ViewDepth)) / 32.0), 1.0);\n"
+	"#else\n"
+	"  write_index(int(texture(u_flat_tex, vec3(TexCoords, TexIndex)).r), light_row(Light, ViewDepth));\n"
+	"#endif\n"
+	"}\n";
+
+// Wall tex coords are in texels, wrapping happens inside the texture's atlas rect. True-color
+// pages carry a wrapped gutter, so filtering across the rect edge stays seamless
+const char* wall_frag_src =
+	"in vec2 TexCoords;\n"
+	"flat in ivec3 AtlasOrigin;\n"
+	"flat in vec2 AtlasSize;\n"
+	"flat in int Light;\n"
+	"in float ViewDepth;\n"
+	"#ifdef TRUE_COLOR\n"
+	"uniform sampler2DArray u_wall_tex;\n"
+	"#else\n"
 	"uniform usampler2DArray u_wall_tex;\n"
-	"uniform sampler1DArray u_palettes;\n"
-	"uniform int u_palette_index;\n"
+	"#endif\n"
 	"void main() {\n"
-	"  vec3 color;\n"
-	"  if (TexIndex == -1) { discard; }\n"
-	"  else if (TexType == 0) {\n"
-	"    color = vec3(texelFetch(u_palettes, ivec2(TexIndex, u_palette_index), 0));\n"
-	"  } else if (TexType == 1) {\n"
-	"    color = vec3(texelFetch(u_palettes, ivec2(int(texture(u_flat_tex, vec3(TexCoords, TexIndex)).r), u_palette_index), 0));\n"
-	"  } else if (TexType == 2) {\n"
-	"    color = vec3(texelFetch(u_palettes, ivec2(int(texture(u_wall_tex, vec3(fract(TexCoords / MaxTexCoords) * MaxTexCoords, TexIndex)).r), u_palette_index), 0));\n"
-	"  }\n"
-	"  fragColor = vec4(color * Light, 1.0);\n"
+	"#ifdef TRUE_COLOR\n"
+	"  vec2 scale = 1.0 / vec2(textureSize(u_wall_tex, 0).xy);\n"
+	"  vec2 texel = vec2(AtlasOrigin.xy) + mod(TexCoords, AtlasSize);\n"
+	"  vec3 color = textureGrad(u_wall_tex, vec3(texel * scale, AtlasOrigin.z), dFdx(TexCoords) * scale, dFdy(TexCoords) * scale).rgb;\n"
+	"  color = mix(color, u_palette_tint.rgb, u_palette_tint.a);\n"
+	"  fragColor = vec4(color * (1.0 - float(light_row(Light, ViewDepth)) / 32.0), 1.0);\n"
+	"#else\n"
+	// mod() of a tiny negative coordinate can round up to AtlasSize, which is the next rect
+	"  ivec2 texel = min(ivec2(mod(TexCoords, AtlasSize)), ivec2(AtlasSize) - 1);\n"
+	"  write_index(int(texelFetch(u_wall_tex, AtlasOrigin + ivec3(texel, 0), 0).r), light_row(Light, ViewDepth));\n"
+	"#endif\n"
 	"}\n";
 
-const char* plain_vert_src =
-	"#version 330 core\n"
+const char* sky_mask_vert_src =
 	"layout (location = 0) in vec3 pos;\n"
-	"uniform mat4 u_model;\n"
-	"uniform mat4 u_view;\n"
-	"uniform mat4 u_projection;\n"
+	"layout (location = 1) in mat4 instanceModel;\n"
 	"void main() {\n"
-	"  gl_Position = u_projection * u_view * u_model * vec4(pos, 1.0);\n"
+	"  gl_Position = u_view_projection * instanceModel * vec4(pos, 1.0);\n"
 	"}\n";
 
-const char* plain_frag_src =
-	"#version 330 core\n"
-	"out vec4 fragColor;\n"
+const char* sky_mask_frag_src =
 	"void main() {\n"
-	"  fragColor = vec4(1.0, 1.0, 1.0, 1.0);\n"
 	"}\n";
 
 const char* sky_vert_src =
-	"#version 330 core\n"
 	"layout (location = 0) in vec3 pos;\n"
 	"out vec3 TexCoords;\n"
-	"uniform mat4 u_view;\n"
-	"uniform mat4 u_projection;\n"
 	"void main() {\n"
 	"  gl_Position = u_projection * mat4(mat3(u_view)) * vec4(pos, 1.0);\n"
 	"  TexCoords = pos;\n"
 	"}\n";
 
 const char* sky_frag_src =
-	"#version 330 core\n"
 	"in vec3 TexCoords;\n"
-	"out vec4 fragColor;\n"
-	"uniform sampler1DArray u_palettes;\n"
 	"uniform usamplerCube u_sky;\n"
-	"uniform int u_palette_index;\n"
 	"void main() {\n"
-	"  fragColor = texelFetch(u_palettes, ivec2(int(texture(u_sky, TexCoords).r), u_palette_index), 0);\n"
+	"  write_index(int(texture(u_sky, TexCoords).r), 0);\n"
+	"}\n";
+
+// Full-screen triangle from gl_VertexID, no vertex buffer needed
+const char* resolve_vert_src =
+	"void main() {\n"
+	"  vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+	"  gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);\n"
+	"}\n";
+
+// Scene upscale for dynamic resolution. Sharp bilinear stays nearest inside a source texel and
+// blends only across the one output pixel that straddles a texel edge
+const char* upscale_frag_src =
+	"out vec4 fragColor;\n"
+	"uniform sampler2D u_scene;\n"
+	"uniform vec2 u_source_size;\n"
+	"uniform vec2 u_output_size;\n"
+	"void main() {\n"
+	"  vec2 texel = gl_FragCoord.xy / u_output_size * u_source_size;\n"
+	"#ifdef SHARP_BILINEAR\n"
+	"  vec2 scale = u_output_size / u_source_size;\n"
+	"  vec2 center_dist = fract(texel) - 0.5;\n"
+	"  vec2 range = 0.5 - 0.5 / scale;\n"
+	"  vec2 f = (center_dist - clamp(center_dist, -range, range)) * scale + 0.5;\n"
+	"  fragColor = texture(u_scene, (floor(texel) + f) / vec2(textureSize(u_scene, 0)));\n"
+	"#else\n"
+	"  fragColor = texelFetch(u_scene, ivec2(texel), 0);\n"
+	"#endif\n"
+	"}\n";
+
+const char* resolve_frag_src =
+	"out vec4 fragColor;\n"
+	"uniform usampler2D u_indexed;\n"
+	"uniform sampler2DArray u_colormap;\n"
+	"void main() {\n"
+	"  ivec2 texel = ivec2(texelFetch(u_indexed, ivec2(gl_FragCoord.xy), 0).rg);\n"
+	"  fragColor = vec4(texelFetch(u_colormap, ivec3(texel, u_palette_index), 0).rgb, 1.0);\n"
 	"}\n";
 
+// Per-frame state shared by every program through the FrameData block (std140 layout)
+typedef struct frame_uniforms
+{
+	mat4 view;
+	mat4 projection;
+	mat4 view_projection;
+	int palette_index;
+	float time;
+	float padding[2];
+	vec4 palette_tint;
+} frame_uniforms;
+
+#define FRAME_UNIFORMS_BINDING 0
+#define DEFAULT_FRAME_BUDGET_MS (1000.0f / 60.0f)
+
 static struct
 {
 	GLuint id;
-	GLint model_location, view_location, projection_location;
-	GLint palette_index_location;
+	GLint model_location;
 } shaders[NUM_SHADERS];
 
-static GLuint skybox_vao, skybox_vbo;
+static frame_uniforms frame;
+static bool is_frame_dirty;
+static GLint uniform_buffer_alignment;
+
+static GLuint palette_texture, flat_texture, wall_texture, sky_texture;
+static GLuint flat_anim_table, wall_anim_table;
+static GLuint wall_rects;
+static bool is_true_color;
+static bool is_indexed;
+static render_target indexed_target;
+static GLuint resolve_vao;
+static bool is_dynamic_resolution;
+static bool is_sharp_upscale;
+static render_target scene_target;
+static GLint upscale_source_location, upscale_output_location;
+static vec4* palette_tints;
+static size_t num_palette_tints;
+
+static mesh skybox_mesh;
+static GLint sky_scissor[4];
 static float width;
 static float height;
+// Size of the region actually rendered to, below the window size with dynamic resolution
+static int render_width;
+static int render_height;
 
 void renderer_init(int w, int h)
 {
 	width = w;
 	height = h;
+	render_width = w;
+	render_height = h;
+	is_true_color = args_has("-truecolor");
+	is_indexed = args_has("-indexed");
+	is_dynamic_resolution = args_has("-dynres");
+	is_sharp_upscale = args_has("-sharp");
+	if (is_indexed && is_true_color)
+	{
+		fprintf(stderr, "-indexed has no effect in true-color mode\n");
+		is_indexed = false;
+	}
 
-	glClearColor(0.15f, 0.15f, 0.15f, 1.0f);
+	// Black, palette index 0, so every mode shows the same void as the indexed and software paths
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glEnable(GL_STENCIL_TEST);
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
@@ -122,8 +275,28 @@ void renderer_init(int w, int h)
 	glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
 	glStencilFunc(GL_ALWAYS, 1, 0xff);
 
+	stream_buffer_init();
+	texture_upload_init();
 	init_skybox();
 	init_shaders();
+	init_frame_uniforms();
+	render_queue_init();
+
+	glGenVertexArrays(1, &resolve_vao);
+
+	if (is_indexed && render_target_create(&indexed_target, w, h, GL_RG8UI, GL_NEAREST) != 0)
+		is_indexed = false;
+
+	if (is_dynamic_resolution)
+	{
+		if (render_target_create(&scene_target, w, h, GL_RGBA8, is_sharp_upscale ? GL_LINEAR : GL_NEAREST) == 0)
+		{
+			const char* budget = args_get("-dynres");
+			dynamic_resolution_init(budget != NULL && budget[0] != '-' ? atof(budget) : DEFAULT_FRAME_BUDGET_MS);
+		}
+		else
+			is_dynamic_resolution = false;
+	}
 }
 
 void renderer_clear()
@@ -131,58 +304,139 @@ void renderer_clear()
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 }
 
-void renderer_set_palette_texture(GLuint palette_texture)
+void renderer_begin_frame()
 {
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_1D_ARRAY, palette_texture);
+	stream_buffer_begin_frame();
+
+	// Last frame's copy lives in a region that is about to be reused
+	is_frame_dirty = true;
+
+	if (is_dynamic_resolution)
+	{
+		// Multiples of 8 keep the size from jittering by a pixel every frame
+		dynamic_resolution_begin_frame();
+		float scale = dynamic_resolution_get_scale();
+		render_width = max(((int)(width * scale) + 7) / 8 * 8, 8);
+		render_height = max(((int)(height * scale) + 7) / 8 * 8, 8);
+		render_width = min(render_width, (int)width);
+		render_height = min(render_height, (int)height);
+	}
+
+	if (is_indexed)
+	{
+		static const GLuint clear_index[4] = { 0, 0, 0, 0 };
+		render_target_bind_region(&indexed_target, render_width, render_height);
+		glClearBufferuiv(GL_COLOR, 0, clear_index);
+		glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	}
+	else if (is_dynamic_resolution)
+	{
+		render_target_bind_region(&scene_target, render_width, render_height);
+		renderer_clear();
+	}
+	else
+		renderer_clear();
 }
 
-void renderer_set_palette_index(int index)
+void renderer_end_frame()
 {
-	for (int i = 0; i < NUM_SHADERS; i++)
+	if (is_indexed)
 	{
-		glUseProgram(shaders[i].id);
-		if (shaders[i].palette_index_location != -1)
-			glUniform1i(shaders[i].palette_index_location, index);
+		if (is_dynamic_resolution)
+			render_target_bind_region(&scene_target, render_width, render_height);
+		else
+			render_target_bind_default(width, height);
+
+		resolve_indexed();
+	}
+
+	if (is_dynamic_resolution)
+	{
+		upscale_scene();
+		dynamic_resolution_end_frame();
 	}
+
+	stream_buffer_end_frame();
+}
+
+float renderer_get_resolution_scale()
+{
+	return (float)render_width / width;
+}
+
+void renderer_set_palette_texture(GLuint texture)
+{
+	palette_texture = texture;
 }
 
-void renderer_set_wall_texture(GLuint texture)
+void renderer_set_palette_index(int index)
+{
+	frame.palette_index = index;
+	if (index >= 0 && index < num_palette_tints)
+		frame.palette_tint = palette_tints[index];
+	is_frame_dirty = true;
+}
+
+void renderer_set_palettes(const palette* palettes, size_t num)
+{
+	free(palette_tints);
+	palette_tints = malloc(sizeof(vec4) * (num > 0 ? num : 1));
+	num_palette_tints = num;
+
+	for (size_t i = 0; i < num; i++)
+		palette_tints[i] = palette_compute_tint(&palettes[0], &palettes[i]);
+}
+
+bool renderer_is_true_color()
+{
+	return is_true_color;
+}
+
+bool renderer_is_indexed()
+{
+	return is_indexed;
+}
+
+void renderer_set_time(float time)
 {
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	frame.time = time;
+	is_frame_dirty = true;
+}
+
+void renderer_set_wall_texture(GLuint texture, GLuint rects)
+{
+	wall_texture = texture;
+	wall_rects = rects;
 }
 
 void renderer_set_sky_texture(GLuint texture)
 {
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+	sky_texture = texture;
 }
 
 void renderer_set_flat_texture(GLuint texture)
 {
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	flat_texture = texture;
+}
+
+void renderer_set_anim_tables(GLuint flat_table, GLuint wall_table)
+{
+	flat_anim_table = flat_table;
+	wall_anim_table = wall_table;
 }
 
 void renderer_set_projection(mat4 projection)
 {
-	for (int i = 0; i < NUM_SHADERS; i++)
-	{
-		glUseProgram(shaders[i].id);
-		if (shaders[i].projection_location != -1)
-			glUniformMatrix4fv(shaders[i].projection_location, 1, GL_FALSE, projection.v);
-	}
+	frame.projection = projection;
+	frame.view_projection = mat4_mult(frame.view, frame.projection);
+	is_frame_dirty = true;
 }
 
 void renderer_set_view(mat4 view)
 {
-	for (int i = 0; i < NUM_SHADERS; i++)
-	{
-		glUseProgram(shaders[i].id);
-		if (shaders[i].view_location != -1)
-			glUniformMatrix4fv(shaders[i].view_location, 1, GL_FALSE, view.v);
-	}
+	frame.view = view;
+	frame.view_projection = mat4_mult(frame.view, frame.projection);
+	is_frame_dirty = true;
 }
 
 vec2 renderer_get_size()
@@ -190,54 +444,193 @@ vec2 renderer_get_size()
 	return (vec2) { width, height };
 }
 
-void renderer_draw_mesh(const mesh* mesh, int shader, mat4 transformation)
+void renderer_draw_sky(vec2 min, vec2 max)
 {
-	glUseProgram(shaders[shader].id);
-	glUniformMatrix4fv(shaders[shader].model_location, 1, GL_FALSE, transformation.v);
+	min.x = fmaxf(min.x, -1.0f), min.y = fmaxf(min.y, -1.0f);
+	max.x = fminf(max.x, 1.0f), max.y = fminf(max.y, 1.0f);
+
+	sky_scissor[0] = (GLint)floorf((min.x * 0.5f + 0.5f) * render_width);
+	sky_scissor[1] = (GLint)floorf((min.y * 0.5f + 0.5f) * render_height);
+	sky_scissor[2] = (GLint)ceilf((max.x * 0.5f + 0.5f) * render_width) - sky_scissor[0];
+	sky_scissor[3] = (GLint)ceilf((max.y * 0.5f + 0.5f) * render_height) - sky_scissor[1];
+
+	draw_item item = {
+		.mesh = &skybox_mesh,
+		.num_indices = skybox_mesh.num_indices,
+		.shader = SHADER_SKY,
+		.texture_set = TEXTURE_SET_SKY
+	};
+	render_queue_submit(render_key(RENDER_PASS_SKY, SHADER_SKY, TEXTURE_SET_SKY, skybox_mesh.vao, 0.0f), &item);
+}
 
-	glBindVertexArray(mesh->vao);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ebo);
-	glDrawElements(GL_TRIANGLES, mesh->num_indices, GL_UNSIGNED_INT, NULL);
+void renderer_begin_pass(int pass)
+{
+	flush_frame_uniforms();
+
+	switch (pass)
+	{
+	case RENDER_PASS_SKY_MASK:
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glStencilFunc(GL_ALWAYS, 1, 0xff);
+		glStencilMask(0xff);
+		break;
+	case RENDER_PASS_WORLD:
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glStencilFunc(GL_ALWAYS, 0, 0xff);
+		glStencilMask(0xff);
+		break;
+	case RENDER_PASS_SKY:
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glStencilFunc(GL_EQUAL, 1, 0xff);
+		glStencilMask(0x00);
+		glDisable(GL_CULL_FACE);
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(sky_scissor[0], sky_scissor[1], sky_scissor[2], sky_scissor[3]);
+		break;
+	}
 }
 
-void renderer_draw_sky()
+void renderer_end_passes()
 {
-	glStencilFunc(GL_EQUAL, 1, 0xff);
-	glStencilMask(0x00);
-	glDisable(GL_CULL_FACE);
-	glUseProgram(shaders[SHADER_SKY].id);
-	glBindVertexArray(skybox_vao);
-	glDrawArrays(GL_TRIANGLES, 0, 36);
+	// Leave the default state behind so that renderer_clear() clears the whole framebuffer
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDisable(GL_SCISSOR_TEST);
 	glEnable(GL_CULL_FACE);
 	glStencilMask(0xff);
 	glStencilFunc(GL_ALWAYS, 1, 0xff);
 }
 
+void renderer_bind_shader(int shader)
+{
+	glUseProgram(shaders[shader].id);
+}
+
+void renderer_bind_texture_set(int texture_set)
+{
+	switch (texture_set)
+	{
+	case TEXTURE_SET_WORLD:
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, palette_texture);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, flat_texture);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, wall_texture);
+		glActiveTexture(GL_TEXTURE4);
+		glBindTexture(GL_TEXTURE_BUFFER, flat_anim_table);
+		glActiveTexture(GL_TEXTURE5);
+		glBindTexture(GL_TEXTURE_BUFFER, wall_anim_table);
+		glActiveTexture(GL_TEXTURE6);
+		glBindTexture(GL_TEXTURE_BUFFER, wall_rects);
+		break;
+	case TEXTURE_SET_SKY:
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, palette_texture);
+		glActiveTexture(GL_TEXTURE3);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, sky_texture);
+		break;
+	}
+}
+
+void renderer_set_model(int shader, const mat4* model)
+{
+	if (shaders[shader].model_location == -1)
+		return;
+
+	mat4 identity = mat4_identity();
+	glUniformMatrix4fv(shaders[shader].model_location, 1, GL_FALSE, model ? model->v : identity.v);
+}
+
+void resolve_indexed()
+{
+	flush_frame_uniforms();
+
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_STENCIL_TEST);
+
+	glUseProgram(shaders[SHADER_RESOLVE].id);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, palette_texture);
+	glActiveTexture(GL_TEXTURE7);
+	glBindTexture(GL_TEXTURE_2D, indexed_target.color);
+
+	glBindVertexArray(resolve_vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_STENCIL_TEST);
+}
+
+void upscale_scene()
+{
+	render_target_bind_default(width, height);
+
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_STENCIL_TEST);
+
+	glUseProgram(shaders[SHADER_UPSCALE].id);
+	glUniform2f(upscale_source_location, render_width, render_height);
+	glUniform2f(upscale_output_location, width, height);
+	glActiveTexture(GL_TEXTURE7);
+	glBindTexture(GL_TEXTURE_2D, scene_target.color);
+
+	glBindVertexArray(resolve_vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_STENCIL_TEST);
+}
+
 void init_shaders()
 {
 	struct
 	{
+		const char* defines;
 		const char* vert;
 		const char* frag;
 	} shader_units[NUM_SHADERS] = {
-		[SHADER_DEFAULT] = {vert_src, frag_src},
-		[SHADER_SKY] = {sky_vert_src, sky_frag_src},
-		[SHADER_PLAIN] = {plain_vert_src, plain_frag_src}
+		[SHADER_FLAT] = {"#define TEX_ANIM_TABLE u_flat_anim\n", world_vert_src, flat_frag_src},
+		[SHADER_WALL] = {"#define TEX_ANIM_TABLE u_wall_anim\n#define WALL_ATLAS\n", world_vert_src, wall_frag_src},
+		[SHADER_SKY] = {"", sky_vert_src, sky_frag_src},
+		[SHADER_SKY_MASK] = {"", sky_mask_vert_src, sky_mask_frag_src},
+		[SHADER_RESOLVE] = {"", resolve_vert_src, resolve_frag_src},
+		[SHADER_UPSCALE] = {is_sharp_upscale ? "#define SHARP_BILINEAR\n" : "", resolve_vert_src, upscale_frag_src}
 	};
 
+	const char* color_define = is_true_color ? "#define TRUE_COLOR\n" : is_indexed ? "#define INDEXED_TARGET\n" : "";
+
+	program_desc descs[NUM_SHADERS];
+	for (int i = 0; i < NUM_SHADERS; i++)
+	{
+		// The resolve pass writes colors itself
+		const char* output = i == SHADER_RESOLVE || i == SHADER_UPSCALE ? "" : fragment_output_src;
+
+		descs[i] = (program_desc){
+			.num_vert_sources = 5,
+			.vert_sources = { version_src, color_define, shader_units[i].defines, frame_block_src, shader_units[i].vert },
+			.num_frag_sources = 6,
+			.frag_sources = { version_src, color_define, shader_units[i].defines, frame_block_src, output, shader_units[i].frag }
+		};
+	}
+
+	GLuint programs[NUM_SHADERS];
+	program_cache_build(NUM_SHADERS, descs, programs);
+
+	program_cache_stats stats = program_cache_get_stats();
+	printf("Shaders: %zu cached, %zu compiled in %.1f ms\n", stats.num_hits, stats.num_misses, stats.seconds * 1000.0);
+
 	for (int i = 0; i < NUM_SHADERS; i++)
 	{
-		GLuint vertex = compile_shader(GL_VERTEX_SHADER, shader_units[i].vert);
-		GLuint fragment = compile_shader(GL_FRAGMENT_SHADER, shader_units[i].frag);
-		shaders[i].id = link_shader(2, vertex, fragment);
+		shaders[i].id = programs[i];
 		glUseProgram(shaders[i].id);
 
-		shaders[i].projection_location = glGetUniformLocation(shaders[i].id, "u_projection");
 		shaders[i].model_location = glGetUniformLocation(shaders[i].id, "u_model");
-		shaders[i].view_location = glGetUniformLocation(shaders[i].id, "u_view");
-		shaders[i].palette_index_location = glGetUniformLocation(shaders[i].id, "u_palette_index");
 
-		GLint palette_location = glGetUniformLocation(shaders[i].id, "u_palettes");
+		GLuint frame_block_index = glGetUniformBlockIndex(shaders[i].id, "FrameData");
+		if (frame_block_index != GL_INVALID_INDEX)
+			glUniformBlockBinding(shaders[i].id, frame_block_index, FRAME_UNIFORMS_BINDING);
+
+		GLint palette_location = glGetUniformLocation(shaders[i].id, "u_colormap");
 		if (palette_location != -1)
 			glUniform1i(palette_location, 0);
 
@@ -252,7 +645,51 @@ void init_shaders()
 		GLint sky_texture_location = glGetUniformLocation(shaders[i].id, "u_sky");
 		if (sky_texture_location != -1)
 			glUniform1i(sky_texture_location, 3);
+
+		GLint flat_anim_location = glGetUniformLocation(shaders[i].id, "u_flat_anim");
+		if (flat_anim_location != -1)
+			glUniform1i(flat_anim_location, 4);
+
+		GLint wall_anim_location = glGetUniformLocation(shaders[i].id, "u_wall_anim");
+		if (wall_anim_location != -1)
+			glUniform1i(wall_anim_location, 5);
+
+		GLint wall_rects_location = glGetUniformLocation(shaders[i].id, "u_wall_rects");
+		if (wall_rects_location != -1)
+			glUniform1i(wall_rects_location, 6);
+
+		GLint indexed_location = glGetUniformLocation(shaders[i].id, "u_indexed");
+		if (indexed_location != -1)
+			glUniform1i(indexed_location, 7);
+
+		GLint scene_location = glGetUniformLocation(shaders[i].id, "u_scene");
+		if (scene_location != -1)
+			glUniform1i(scene_location, 7);
 	}
+
+	upscale_source_location = glGetUniformLocation(shaders[SHADER_UPSCALE].id, "u_source_size");
+	upscale_output_location = glGetUniformLocation(shaders[SHADER_UPSCALE].id, "u_output_size");
+}
+
+void init_frame_uniforms()
+{
+	frame.view = frame.projection = frame.view_projection = mat4_identity();
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_buffer_alignment);
+	is_frame_dirty = true;
+}
+
+void flush_frame_uniforms()
+{
+	if (!is_frame_dirty)
+		return;
+
+	stream_allocation alloc = stream_buffer_alloc(sizeof(frame_uniforms), uniform_buffer_alignment);
+	if (alloc.data == NULL)
+		return;
+
+	memcpy(alloc.data, &frame, sizeof(frame_uniforms));
+	glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, alloc.buffer, alloc.offset, sizeof(frame_uniforms));
+	is_frame_dirty = false;
 }
 
 void init_skybox()
@@ -271,11 +708,9 @@ void init_skybox()
 		-1.0f,-1.0f,-1.0f,-1.0f, 1.0f, 1.0f,-1.0f, 1.0f
 	};
 
-	glGenVertexArrays(1, &skybox_vao);
-	glGenBuffers(1, &skybox_vbo);
-	glBindVertexArray(skybox_vao);
-	glBindBuffer(GL_ARRAY_BUFFER, skybox_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertices, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	uint32_t indices[36];
+	for (uint32_t i = 0; i < 36; i++)
+		indices[i] = i;
+
+	mesh_create(&skybox_mesh, VERTEX_LAYOUT_PLAIN, 36, vertices, 36, indices, false);
 }
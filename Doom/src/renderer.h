@@ -2,28 +2,79 @@
 #include "math/vector.h"
 #include "math/matrix.h"
 #include "mesh.h"
+#include "palette.h"
+
+#include <stdbool.h>
+#include <stddef.h>
 
 void renderer_init(int width, int height);
 void renderer_clear();
 
+// Bracket everything that streams per-frame data, see stream_buffer.h
+void renderer_begin_frame();
+void renderer_end_frame();
+
+// The COLORMAP lookup from palettes_generate_colormap_texture()
 void renderer_set_palette_texture(GLuint palette_texture);
 void renderer_set_palette_index(int index);
-void renderer_set_wall_texture(GLuint texture);
+// Fits the tints true-color mode uses in place of a palette switch
+void renderer_set_palettes(const palette* palettes, size_t num);
+void renderer_set_time(float time);
+void renderer_set_wall_texture(GLuint texture, GLuint rects);
 void renderer_set_flat_texture(GLuint texture);
 void renderer_set_sky_texture(GLuint texture);
+void renderer_set_anim_tables(GLuint flat_table, GLuint wall_table);
 void renderer_set_projection(mat4 projection);
 void renderer_set_view(mat4 view);
 
 vec2 renderer_get_size();
+// Set with -truecolor, textures are then expanded to RGBA8 with mipmaps at load time
+bool renderer_is_true_color();
+// Set with -indexed, the world is drawn into an RG8UI target (palette index, light) and
+// resolved to color once per pixel by renderer_end_frame()
+bool renderer_is_indexed();
+// Set with -dynres [budget ms], the scene is rendered at a reduced size that tracks the
+// GPU frame time and upscaled to the window (nearest, or sharp bilinear with -sharp)
+float renderer_get_resolution_scale();
 
 enum
 {
-	SHADER_DEFAULT,
+	SHADER_FLAT,
+	SHADER_WALL,
 	SHADER_SKY,
-	SHADER_PLAIN,
+	SHADER_SKY_MASK,
+	SHADER_RESOLVE,
+	SHADER_UPSCALE,
 
 	NUM_SHADERS
 };
 
-void renderer_draw_mesh(const mesh* mesh, int shader, mat4 transformation);
-void renderer_draw_sky();
+enum
+{
+	TEXTURE_SET_NONE,
+	TEXTURE_SET_WORLD,
+	TEXTURE_SET_SKY,
+
+	NUM_TEXTURE_SETS
+};
+
+// Passes are submitted in enum order. The sky mask goes first as a depth and stencil only
+// occluder, world geometry in front of it then resets the stencil to 0 where it passes
+enum
+{
+	RENDER_PASS_SKY_MASK,
+	RENDER_PASS_WORLD,
+	RENDER_PASS_SKY,
+
+	NUM_RENDER_PASSES
+};
+
+// Queues the skybox into RENDER_PASS_SKY, scissored to the given NDC rectangle
+void renderer_draw_sky(vec2 min, vec2 max);
+
+// Low-level state used by the render queue, none of these skip redundant calls
+void renderer_begin_pass(int pass);
+void renderer_end_passes();
+void renderer_bind_shader(int shader);
+void renderer_bind_texture_set(int texture_set);
+void renderer_set_model(int shader, const mat4* model);
@@ -0,0 +1,177 @@
+#include "software/present.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#define GLFW_EXPOSE_NATIVE_WIN32
+#include "GLFW/glfw3native.h"
+#elif defined(__linux__)
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+// From glfw3native.h, which would also pull in Xrandr for functions not used here
+GLFWAPI Display* glfwGetX11Display(void);
+GLFWAPI Window glfwGetX11Window(GLFWwindow* window);
+#endif
+
+static int width, height;
+static uint32_t* staging; // Pixels in the layout the platform blit wants
+
+#if defined(_WIN32)
+
+static HWND hwnd;
+static HDC dc;
+static BITMAPINFO info;
+
+bool present_init(GLFWwindow* window, int w, int h)
+{
+	width = w;
+	height = h;
+	hwnd = glfwGetWin32Window(window);
+	dc = GetDC(hwnd);
+	if (dc == NULL)
+	{
+		fprintf(stderr, "Failed to get the window's device context\n");
+		return false;
+	}
+
+	// A positive height is a bottom-up DIB, the same row order the renderer writes
+	info.bmiHeader = (BITMAPINFOHEADER){
+		.biSize = sizeof(BITMAPINFOHEADER),
+		.biWidth = width,
+		.biHeight = height,
+		.biPlanes = 1,
+		.biBitCount = 32,
+		.biCompression = BI_RGB
+	};
+	staging = malloc(sizeof(uint32_t) * width * height);
+	return true;
+}
+
+void present_frame(const uint32_t* pixels)
+{
+	if (staging == NULL)
+		return;
+
+	// BI_RGB wants BGRA
+	const uint8_t* src = (const uint8_t*)pixels;
+	for (size_t i = 0; i < (size_t)width * height; i++, src += 4)
+		staging[i] = (uint32_t)src[2] | (uint32_t)src[1] << 8 | (uint32_t)src[0] << 16;
+
+	RECT rect;
+	GetClientRect(hwnd, &rect);
+	StretchDIBits(dc, 0, 0, rect.right - rect.left, rect.bottom - rect.top, 0, 0, width, height,
+		staging, &info, DIB_RGB_COLORS, SRCCOPY);
+}
+
+void present_shutdown()
+{
+	if (dc != NULL)
+		ReleaseDC(hwnd, dc);
+	dc = NULL;
+	free(staging);
+	staging = NULL;
+}
+
+#elif defined(__linux__)
+
+static Display* display;
+static Window xwindow;
+static GC gc;
+static XImage* image;
+static int red_shift, green_shift, blue_shift;
+
+static int mask_shift(unsigned long mask);
+
+bool present_init(GLFWwindow* window, int w, int h)
+{
+	width = w;
+	height = h;
+	display = glfwGetX11Display();
+	if (display == NULL)
+	{
+		fprintf(stderr, "Software presenting needs GLFW's X11 backend\n");
+		return false;
+	}
+	xwindow = glfwGetX11Window(window);
+
+	XWindowAttributes attributes;
+	XGetWindowAttributes(display, xwindow, &attributes);
+	if (attributes.visual->class != TrueColor || attributes.depth < 24)
+	{
+		fprintf(stderr, "Software presenting needs a 24 bit TrueColor visual\n");
+		display = NULL;
+		return false;
+	}
+
+	red_shift = mask_shift(attributes.visual->red_mask);
+	green_shift = mask_shift(attributes.visual->green_mask);
+	blue_shift = mask_shift(attributes.visual->blue_mask);
+
+	staging = malloc(sizeof(uint32_t) * width * height);
+	image = XCreateImage(display, attributes.visual, attributes.depth, ZPixmap, 0, (char*)staging, width, height, 32, 0);
+	gc = XCreateGC(display, xwindow, 0, NULL);
+	return true;
+}
+
+void present_frame(const uint32_t* pixels)
+{
+	if (display == NULL)
+		return;
+
+	// X images are top-down
+	for (int y = 0; y < height; y++)
+	{
+		const uint8_t* src = (const uint8_t*)&pixels[(size_t)(height - 1 - y) * width];
+		uint32_t* dest = &staging[(size_t)y * width];
+		for (int x = 0; x < width; x++, src += 4)
+			dest[x] = (uint32_t)src[0] << red_shift | (uint32_t)src[1] << green_shift | (uint32_t)src[2] << blue_shift;
+	}
+
+	XPutImage(display, xwindow, gc, image, 0, 0, 0, 0, width, height);
+	XFlush(display);
+}
+
+void present_shutdown()
+{
+	if (display != NULL)
+	{
+		// The pixels are ours, not Xlib's
+		image->data = NULL;
+		XDestroyImage(image);
+		XFreeGC(display, gc);
+		display = NULL;
+	}
+	free(staging);
+	staging = NULL;
+}
+
+int mask_shift(unsigned long mask)
+{
+	int shift = 0;
+	while (mask != 0 && (mask & 1) == 0)
+	{
+		mask >>= 1;
+		shift++;
+	}
+	return shift;
+}
+
+#else
+
+bool present_init(GLFWwindow* window, int w, int h)
+{
+	fprintf(stderr, "Software presenting is not supported on this platform\n");
+	return false;
+}
+
+void present_frame(const uint32_t* pixels)
+{
+}
+
+void present_shutdown()
+{
+}
+
+#endif
@@ -0,0 +1,12 @@
+#pragma once
+#include "GLFW/glfw3.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Shows software frames in a window created with GLFW_NO_API, through GDI on Windows and
+// XPutImage on X11, so -software needs no graphics API at all
+bool present_init(GLFWwindow* window, int width, int height);
+// Bottom-up RGBA8 rows of the size given to present_init
+void present_frame(const uint32_t* pixels);
+void present_shutdown();
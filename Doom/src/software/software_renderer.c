@@ -0,0 +1,800 @@
+#include "software/software_renderer.h"
+#include "software/present.h"
+#include "args.h"
+#include "thread_pool.h"
+#include "timer.h"
+#include "utils.h"
+#include "engine/anim.h"
+#include "engine/state.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SW_USE_SSE
+#include <emmintrin.h>
+#endif
+
+#define NEAR_PLANE (1.0f)
+#define SLICES_PER_THREAD 2	// A little slack for slices that see more of the map
+#define MAX_PITCH_SHEAR (1.5f)
+#define SKY_TEXELS_PER_TURN (1024.0f)	// The 256 wide sky repeats 4 times, as in vanilla
+#define SKY_TEXTURE_MID (100.0f)
+#define SKY_FOCAL (160.0f)	// Vanilla's 320x200 focal length, where sky texels map 1:1 to pixels
+#define LIGHT_FADE (1280.0f)	// Colormap rows fade in by LIGHT_FADE / depth, see light_row()
+#define FLAT_ROW_SHIFT 6	// log2(FLAT_TEXTURE_SIZE)
+
+typedef struct sw_texture
+{
+	int width, height;
+	uint8_t* columns; // Column-major so a wall column reads contiguous texels
+} sw_texture;
+
+typedef struct sw_view
+{
+	vec2 position;
+	float eye_height;
+	vec2 forward, right; // Horizontal, screen x follows right
+	float focal;
+	float center_x, center_y;
+	const int32_t* flat_anim;
+	const int32_t* wall_anim;
+} sw_view;
+
+typedef struct sw_slice
+{
+	const sw_view* view;
+	int x0, x1;
+	int open_columns;
+} sw_slice;
+
+// One wall part of a segment, heights in map units and v_top in texels at top_height
+typedef struct sw_wall_part
+{
+	const sw_texture* texture;
+	float top_height;
+	float v_top;
+} sw_wall_part;
+
+static void render_slice(void* data, int index);
+static void convert_rows(void* data, int index);
+static void render_bsp_node(sw_slice* slice, uint16_t id);
+static bool is_bbox_visible(const sw_slice* slice, const int16_t* bbox);
+static void render_subsector(sw_slice* slice, int index);
+static void render_segment(sw_slice* slice, const gl_segment* segment, const sector* front_sector);
+static void draw_wall_column(uint8_t* dest, int y0, int y1, const sw_wall_part* part, float u, float depth, const sw_view* view, const uint8_t* colormap);
+static void draw_flat_column(uint8_t* dest, int y0, int y1, int flat, float plane_height, vec2 position, vec2 ray, int light_level);
+static void draw_sky_column(uint8_t* dest, int y0, int y1, int x, const sw_view* view);
+static const sw_texture* get_wall(const sw_view* view, int texture);
+static vec2 get_vertex(uint16_t index);
+static int light_row(int light_level, float depth);
+static void free_textures();
+
+static bool is_enabled;
+static int width, height;
+static int num_slices;
+static uint8_t* framebuffer;	// Column-major palette indices
+static uint32_t* rgba;		// Bottom-up RGBA8 rows, ready to present
+static int16_t* clip_top;	// Per column, first row still open
+static int16_t* clip_bottom;	// Per column, one past the last row still open
+static float* row_slope;	// Focal length over the distance of a row centre from the horizon
+static float* row_inv_slope;	// 1 / row_slope, flats fade with it instead of dividing per pixel
+static vec2* column_rays;	// Horizontal direction through each column, forward component 1
+static float* column_sky_u;
+static double* job_times;
+
+static uint8_t colormaps[NUM_LIGHT_COLORMAPS][NUM_COLORS];
+static uint32_t* palette_colors;
+static size_t num_palette_colors;
+static int current_palette;
+
+static const flat_tex* flat_textures;
+static size_t num_flat_textures;
+static sw_texture* walls;
+static size_t num_walls;
+static int sky_texture = -1;
+
+static bool is_presenting;
+static software_stats stats;
+static double total_frame_time, total_busy_time;
+static int num_frames;
+
+void software_renderer_init(GLFWwindow* window, int w, int h)
+{
+	is_enabled = args_has("-software");
+	if (!is_enabled)
+		return;
+
+	width = w;
+	height = h;
+
+	num_slices = min(thread_pool_get_num_threads() * SLICES_PER_THREAD, width);
+
+	framebuffer = malloc((size_t)width * height);
+	rgba = malloc(sizeof(uint32_t) * width * height);
+	clip_top = malloc(sizeof(int16_t) * width);
+	clip_bottom = malloc(sizeof(int16_t) * width);
+	row_slope = malloc(sizeof(float) * height);
+	row_inv_slope = malloc(sizeof(float) * height);
+	column_rays = malloc(sizeof(vec2) * width);
+	column_sky_u = malloc(sizeof(float) * width);
+	job_times = calloc(num_slices * 2, sizeof(double));
+
+	// Headless runs keep the frame in rgba, capture reads it from there
+	is_presenting = window != NULL && present_init(window, width, height);
+
+	stats.num_threads = thread_pool_get_num_threads();
+	printf("Software renderer: %d threads, %d slices\n", stats.num_threads, num_slices);
+}
+
+void software_renderer_shutdown()
+{
+	if (!is_enabled)
+		return;
+
+	if (num_frames > 0)
+	{
+		double fps = num_frames / total_frame_time;
+		double fps_per_core = num_frames / total_busy_time;
+		printf("Software renderer: %d frames at %dx%d, %.1f fps on %d threads, %.1f fps per core\n",
+			num_frames, width, height, fps, stats.num_threads, fps_per_core);
+	}
+
+	present_shutdown();
+	free_textures();
+	free(framebuffer);
+	free(rgba);
+	free(clip_top);
+	free(clip_bottom);
+	free(row_slope);
+	free(row_inv_slope);
+	free(column_rays);
+	free(column_sky_u);
+	free(job_times);
+	free(palette_colors);
+}
+
+bool software_renderer_is_enabled()
+{
+	return is_enabled;
+}
+
+void software_renderer_set_palettes(const palette* palettes, size_t num, const colormap* maps, size_t num_maps)
+{
+	free(palette_colors);
+	num_palette_colors = num;
+	palette_colors = malloc(sizeof(uint32_t) * NUM_COLORS * (num > 0 ? num : 1));
+	for (size_t i = 0; i < num * NUM_COLORS; i++)
+	{
+		const uint8_t* color = &palettes[i / NUM_COLORS].colors[(i % NUM_COLORS) * 3];
+		uint8_t texel[4] = { color[0], color[1], color[2], 255 };
+		memcpy(&palette_colors[i], texel, 4);
+	}
+
+	if (num_maps >= NUM_LIGHT_COLORMAPS)
+	{
+		for (int row = 0; row < NUM_LIGHT_COLORMAPS; row++)
+			memcpy(colormaps[row], maps[row].indices, NUM_COLORS);
+		return;
+	}
+
+	// Same linear fallback as the GPU path, matched back to the closest palette entry
+	for (int row = 0; row < NUM_LIGHT_COLORMAPS; row++)
+	{
+		float scale = 1.0f - (float)row / NUM_LIGHT_COLORMAPS;
+		for (int i = 0; i < NUM_COLORS; i++)
+		{
+			const uint8_t* color = &palettes[0].colors[i * 3];
+			int best = i, best_distance = INT32_MAX;
+			for (int j = 0; j < NUM_COLORS; j++)
+			{
+				const uint8_t* other = &palettes[0].colors[j * 3];
+				int distance = 0;
+				for (int c = 0; c < 3; c++)
+				{
+					int d = (int)(color[c] * scale) - other[c];
+					distance += d * d;
+				}
+
+				if (distance < best_distance)
+				{
+					best_distance = distance;
+					best = j;
+				}
+			}
+
+			colormaps[row][i] = (uint8_t)best;
+		}
+	}
+}
+
+void software_renderer_set_textures(const flat_tex* resident_flats, size_t num_resident_flats, const wall_tex* textures, size_t num_textures)
+{
+	free_textures();
+
+	flat_textures = resident_flats;
+	num_flat_textures = num_resident_flats;
+
+	num_walls = num_textures;
+	walls = malloc(sizeof(sw_texture) * (num_textures > 0 ? num_textures : 1));
+	sky_texture = -1;
+	for (size_t i = 0; i < num_textures; i++)
+	{
+		const wall_tex* texture = &textures[i];
+		sw_texture* wall = &walls[i];
+		wall->width = texture->width > 0 ? texture->width : 1;
+		wall->height = texture->height > 0 ? texture->height : 1;
+		wall->columns = calloc((size_t)wall->width * wall->height, 1);
+
+		if (texture->data != NULL)
+		{
+			for (int y = 0; y < texture->height; y++)
+				for (int x = 0; x < texture->width; x++)
+					wall->columns[x * wall->height + y] = texture->data[y * texture->width + x];
+		}
+
+		if (strncmp_nocase(texture->name, "SKY1", 8) == 0)
+			sky_texture = (int)i;
+	}
+}
+
+void software_renderer_draw(const camera* cam, float fov, int palette_index)
+{
+	double start = timer_now();
+
+	sw_view view;
+	view.position = (vec2){ cam->position.x, cam->position.z };
+	view.eye_height = cam->position.y;
+	view.forward = (vec2){ cosf(cam->yaw), sinf(cam->yaw) };
+	view.right = (vec2){ sinf(cam->yaw), -cosf(cam->yaw) };
+	view.focal = height * 0.5f / tanf(fov * 0.5f);
+	view.center_x = width * 0.5f;
+	// Pitch is a vertical shear of the image, walls stay vertical like in vanilla
+	float shear = fmaxf(-MAX_PITCH_SHEAR, fminf(MAX_PITCH_SHEAR, tanf(cam->pitch)));
+	view.center_y = height * 0.5f + view.focal * shear;
+	view.flat_anim = anim_get_flat_translation();
+	view.wall_anim = anim_get_wall_translation();
+
+	for (int y = 0; y < height; y++)
+	{
+		row_slope[y] = view.focal / fmaxf(fabsf(y + 0.5f - view.center_y), 0.5f);
+		row_inv_slope[y] = 1.0f / row_slope[y];
+	}
+
+	for (int x = 0; x < width; x++)
+	{
+		float a = (x + 0.5f - view.center_x) / view.focal;
+		column_rays[x] = (vec2){ view.forward.x + view.right.x * a, view.forward.y + view.right.y * a };
+
+		float angle = cam->yaw - atanf(a);
+		float u = fmodf(-angle * SKY_TEXELS_PER_TURN / (2.0f * (float)M_PI), SKY_TEXELS_PER_TURN);
+		column_sky_u[x] = u < 0.0f ? u + SKY_TEXELS_PER_TURN : u;
+	}
+
+	current_palette = num_palette_colors > 0 ? min(max(palette_index, 0), (int)num_palette_colors - 1) : 0;
+
+	thread_pool_run(render_slice, &view, num_slices);
+	thread_pool_run(convert_rows, NULL, num_slices);
+
+	double busy = 0.0;
+	for (int i = 0; i < num_slices * 2; i++)
+		busy += job_times[i];
+
+	double elapsed = timer_now() - start;
+	stats.frame_ms = (float)(elapsed * 1000.0);
+	stats.busy_ms = (float)(busy * 1000.0);
+	stats.fps = elapsed > 0.0 ? (float)(1.0 / elapsed) : 0.0f;
+	stats.fps_per_core = busy > 0.0 ? (float)(1.0 / busy) : 0.0f;
+
+	total_frame_time += elapsed;
+	total_busy_time += busy;
+	num_frames++;
+}
+
+void software_renderer_present()
+{
+	if (is_presenting)
+		present_frame(rgba);
+}
+
+const uint32_t* software_renderer_get_pixels()
+{
+	return rgba;
+}
+
+software_stats software_renderer_get_stats()
+{
+	return stats;
+}
+
+void render_slice(void* data, int index)
+{
+	double start = timer_now();
+
+	sw_slice slice;
+	slice.view = data;
+	slice.x0 = index * width / num_slices;
+	slice.x1 = (index + 1) * width / num_slices;
+	slice.open_columns = slice.x1 - slice.x0;
+
+	for (int x = slice.x0; x < slice.x1; x++)
+	{
+		clip_top[x] = 0;
+		clip_bottom[x] = (int16_t)height;
+	}
+	memset(framebuffer + (size_t)slice.x0 * height, 0, (size_t)(slice.x1 - slice.x0) * height);
+
+	if (gl_m.num_nodes > 0)
+		render_bsp_node(&slice, (uint16_t)(gl_m.num_nodes - 1));
+	else
+		render_subsector(&slice, 0);
+
+	job_times[index] = timer_now() - start;
+}
+
+void convert_rows(void* data, int index)
+{
+	double start = timer_now();
+
+	int y0 = index * height / num_slices;
+	int y1 = (index + 1) * height / num_slices;
+	const uint32_t* colors = palette_colors + (size_t)current_palette * NUM_COLORS;
+
+	for (int y = y0; y < y1; y++)
+	{
+		uint32_t* out = rgba + (size_t)(height - 1 - y) * width;
+		const uint8_t* in = framebuffer + y;
+		for (int x = 0; x < width; x++)
+			out[x] = colors[in[(size_t)x * height]];
+	}
+
+	job_times[num_slices + index] = timer_now() - start;
+}
+
+void render_bsp_node(sw_slice* slice, uint16_t id)
+{
+	if (slice->open_columns <= 0)
+		return;
+
+	if (id & 0x8000)
+	{
+		render_subsector(slice, id & 0x7fff);
+		return;
+	}
+
+	if (id >= gl_m.num_nodes)
+		return;
+
+	const gl_node* node = &gl_m.nodes[id];
+	vec2 delta = vec2_sub(slice->view->position, node->partition);
+	bool is_on_back = (delta.x * node->delta_partition.y - delta.y * node->delta_partition.x) <= 0.f;
+
+	// The child the viewer stands in first, the other one only if it can still show up
+	if (is_on_back)
+	{
+		render_bsp_node(slice, node->back_child_id);
+		if (is_bbox_visible(slice, node->front_bbox))
+			render_bsp_node(slice, node->front_child_id);
+	}
+	else
+	{
+		render_bsp_node(slice, node->front_child_id);
+		if (is_bbox_visible(slice, node->back_bbox))
+			render_bsp_node(slice, node->back_child_id);
+	}
+}
+
+bool is_bbox_visible(const sw_slice* slice, const int16_t* bbox)
+{
+	const sw_view* view = slice->view;
+	// top, bottom, left, right
+	vec2 corners[4] = {
+		{ bbox[2], bbox[0] }, { bbox[3], bbox[0] },
+		{ bbox[3], bbox[1] }, { bbox[2], bbox[1] }
+	};
+
+	float min_x = INFINITY, max_x = -INFINITY;
+	int num_behind = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		vec2 d = vec2_sub(corners[i], view->position);
+		float depth = d.x * view->forward.x + d.y * view->forward.y;
+		if (depth < NEAR_PLANE)
+		{
+			num_behind++;
+			continue;
+		}
+
+		float x = view->center_x + view->focal * (d.x * view->right.x + d.y * view->right.y) / depth;
+		min_x = fminf(min_x, x);
+		max_x = fmaxf(max_x, x);
+	}
+
+	if (num_behind == 4)
+		return false;
+
+	// A box crossing the near plane can cover any column
+	int x0 = slice->x0, x1 = slice->x1;
+	if (num_behind == 0)
+	{
+		x0 = max(x0, (int)fmaxf(floorf(min_x), -1.0f));
+		x1 = min(x1, (int)fminf(ceilf(max_x) + 1.0f, (float)width));
+	}
+
+	for (int x = x0; x < x1; x++)
+		if (clip_top[x] < clip_bottom[x])
+			return true;
+
+	return false;
+}
+
+void render_subsector(sw_slice* slice, int index)
+{
+	if (index >= gl_m.num_subsectors)
+		return;
+
+	const gl_subsector* subsector = &gl_m.subsectors[index];
+
+	// Minisegs have no side to take the sector from
+	const sector* sector = NULL;
+	for (int i = 0; i < subsector->num_segs && sector == NULL; i++)
+	{
+		const gl_segment* segment = &gl_m.segments[subsector->first_seg + i];
+		if (segment->linedef == 0xffff)
+			continue;
+
+		const linedef* linedef = &m.linedefs[segment->linedef];
+		uint16_t side = segment->side ? linedef->back_sidedef : linedef->front_sidedef;
+		if (side < m.num_sidedefs)
+			sector = &m.sectors[m.sidedefs[side].sector_index];
+	}
+
+	if (sector == NULL)
+		return;
+
+	for (int i = 0; i < subsector->num_segs && slice->open_columns > 0; i++)
+		render_segment(slice, &gl_m.segments[subsector->first_seg + i], sector);
+}
+
+void render_segment(sw_slice* slice, const gl_segment* segment, const sector* front_sector)
+{
+	const sw_view* view = slice->view;
+	vec2 start = get_vertex(segment->start_vertex);
+	vec2 end = get_vertex(segment->end_vertex);
+
+	// Segments face right, only the side the viewer is on gets drawn
+	vec2 edge = vec2_sub(end, start);
+	vec2 to_view = vec2_sub(view->position, start);
+	if (edge.x * to_view.y - edge.y * to_view.x >= 0.0f)
+		return;
+
+	vec2 d1 = vec2_sub(start, view->position);
+	vec2 d2 = vec2_sub(end, view->position);
+	float s1 = d1.x * view->right.x + d1.y * view->right.y;
+	float z1 = d1.x * view->forward.x + d1.y * view->forward.y;
+	float s2 = d2.x * view->right.x + d2.y * view->right.y;
+	float z2 = d2.x * view->forward.x + d2.y * view->forward.y;
+
+	if (z1 < NEAR_PLANE && z2 < NEAR_PLANE)
+		return;
+
+	// Near clipping only decides the column range, depths come from intersecting each column ray
+	float cs1 = s1, cz1 = z1, cs2 = s2, cz2 = z2;
+	if (z1 < NEAR_PLANE)
+	{
+		float t = (NEAR_PLANE - z1) / (z2 - z1);
+		cs1 = s1 + t * (s2 - s1);
+		cz1 = NEAR_PLANE;
+	}
+	if (z2 < NEAR_PLANE)
+	{
+		float t = (NEAR_PLANE - z1) / (z2 - z1);
+		cs2 = s1 + t * (s2 - s1);
+		cz2 = NEAR_PLANE;
+	}
+
+	float sx1 = view->center_x + view->focal * cs1 / cz1;
+	float sx2 = view->center_x + view->focal * cs2 / cz2;
+	if (sx1 >= sx2)
+		return;
+
+	int x0 = max(slice->x0, (int)fmaxf(ceilf(sx1 - 0.5f), -1.0f));
+	int x1 = min(slice->x1, (int)fminf(ceilf(sx2 - 0.5f), (float)width));
+	if (x0 >= x1)
+		return;
+
+	const sector* back_sector = front_sector;
+	bool is_two_sided = true;
+	const sidedef* sidedef = NULL;
+	const linedef* linedef = NULL;
+	if (segment->linedef != 0xffff)
+	{
+		linedef = &m.linedefs[segment->linedef];
+		uint16_t front_side = segment->side ? linedef->back_sidedef : linedef->front_sidedef;
+		uint16_t back_side = segment->side ? linedef->front_sidedef : linedef->back_sidedef;
+		if (front_side >= m.num_sidedefs)
+			return;
+
+		sidedef = &m.sidedefs[front_side];
+		is_two_sided = (linedef->flags & LINEDEF_FLAGS_TWO_SIDED) && back_side < m.num_sidedefs;
+		if (is_two_sided)
+			back_sector = &m.sectors[m.sidedefs[back_side].sector_index];
+	}
+
+	// Texture placement mirrors meshgen, see generate_meshes()
+	float front_floor = front_sector->floor, front_ceiling = front_sector->ceiling;
+	float back_floor = back_sector->floor, back_ceiling = back_sector->ceiling;
+	bool is_sky = front_sector->ceiling_tex == sky_flat;
+	bool has_upper = is_two_sided && back_ceiling < front_ceiling && !(is_sky && back_sector->ceiling_tex == sky_flat);
+	bool has_lower = is_two_sided && back_floor > front_floor;
+
+	sw_wall_part middle = { 0 }, upper = { 0 }, lower = { 0 };
+	float x_off = 0.0f;
+	if (sidedef != NULL)
+	{
+		float y_off = sidedef->y_off;
+		x_off = sidedef->x_off;
+
+		if (!is_two_sided)
+		{
+			middle.texture = get_wall(view, sidedef->middle);
+			middle.top_height = front_ceiling;
+			middle.v_top = y_off;
+			if (linedef->flags & LINEDEF_FLAGS_LOWER_UNPEGGED)
+				middle.v_top -= front_ceiling - front_floor;
+		}
+
+		if (has_upper)
+		{
+			upper.texture = get_wall(view, sidedef->upper);
+			upper.top_height = front_ceiling;
+			upper.v_top = y_off;
+			if (!(linedef->flags & LINEDEF_FLAGS_UPPER_UNPEGGED))
+				upper.v_top -= front_ceiling - back_ceiling;
+		}
+
+		if (has_lower)
+		{
+			lower.texture = get_wall(view, sidedef->lower);
+			lower.top_height = back_floor;
+			lower.v_top = y_off;
+			if (linedef->flags & LINEDEF_FLAGS_LOWER_UNPEGGED)
+				lower.v_top += front_ceiling - back_floor;
+		}
+	}
+
+	int light_level = min(max(front_sector->light_level, 0), 255);
+	int floor_flat = front_sector->floor_tex;
+	int ceiling_flat = front_sector->ceiling_tex;
+	if (floor_flat >= 0 && floor_flat < num_flat_textures)
+		floor_flat = view->flat_anim[floor_flat];
+	if (ceiling_flat >= 0 && ceiling_flat < num_flat_textures)
+		ceiling_flat = view->flat_anim[ceiling_flat];
+
+	float length = sqrtf(edge.x * edge.x + edge.y * edge.y);
+	float ds = s2 - s1, dz = z2 - z1;
+
+	for (int x = x0; x < x1; x++)
+	{
+		int top = clip_top[x], bottom = clip_bottom[x];
+		if (top >= bottom)
+			continue;
+
+		float a = (x + 0.5f - view->center_x) / view->focal;
+		float denominator = ds - a * dz;
+		if (fabsf(denominator) < 1e-6f)
+			continue;
+
+		float t = (a * z1 - s1) / denominator;
+		float depth = fmaxf(z1 + t * dz, NEAR_PLANE);
+		float scale = view->focal / depth;
+		float u = x_off + t * length;
+
+		// A row is covered when its centre lies below the projected edge
+		int ceiling_y = (int)ceilf(view->center_y - (front_ceiling - view->eye_height) * scale - 0.5f);
+		int floor_y = (int)ceilf(view->center_y - (front_floor - view->eye_height) * scale - 0.5f);
+
+		int wall_top = min(max(ceiling_y, top), bottom);
+		int wall_bottom = max(min(floor_y, bottom), wall_top);
+		uint8_t* dest = framebuffer + (size_t)x * height;
+
+		if (top < wall_top)
+		{
+			if (is_sky)
+				draw_sky_column(dest, top, wall_top, x, view);
+			else if (front_ceiling > view->eye_height)
+				draw_flat_column(dest, top, wall_top, ceiling_flat, front_ceiling - view->eye_height, view->position, column_rays[x], light_level);
+		}
+
+		if (wall_bottom < bottom && front_floor < view->eye_height)
+			draw_flat_column(dest, wall_bottom, bottom, floor_flat, view->eye_height - front_floor, view->position, column_rays[x], light_level);
+
+		const uint8_t* colormap = colormaps[light_row(light_level, depth)];
+
+		if (!is_two_sided)
+		{
+			if (middle.texture != NULL)
+				draw_wall_column(dest, wall_top, wall_bottom, &middle, u, depth, view, colormap);
+
+			clip_top[x] = clip_bottom[x] = (int16_t)bottom;
+			slice->open_columns--;
+			continue;
+		}
+
+		int new_top = wall_top, new_bottom = wall_bottom;
+		if (has_upper)
+		{
+			int upper_y = (int)ceilf(view->center_y - (back_ceiling - view->eye_height) * scale - 0.5f);
+			upper_y = min(max(upper_y, wall_top), wall_bottom);
+			if (upper.texture != NULL)
+				draw_wall_column(dest, wall_top, upper_y, &upper, u, depth, view, colormap);
+			new_top = upper_y;
+		}
+
+		if (has_lower)
+		{
+			int lower_y = (int)ceilf(view->center_y - (back_floor - view->eye_height) * scale - 0.5f);
+			lower_y = min(max(lower_y, new_top), wall_bottom);
+			if (lower.texture != NULL)
+				draw_wall_column(dest, lower_y, wall_bottom, &lower, u, depth, view, colormap);
+			new_bottom = lower_y;
+		}
+
+		clip_top[x] = (int16_t)new_top;
+		clip_bottom[x] = (int16_t)new_bottom;
+		if (new_top >= new_bottom)
+			slice->open_columns--;
+	}
+}
+
+void draw_wall_column(uint8_t* dest, int y0, int y1, const sw_wall_part* part, float u, float depth, const sw_view* view, const uint8_t* colormap)
+{
+	if (y0 >= y1)
+		return;
+
+	const sw_texture* texture = part->texture;
+	int tx = (int)floorf(u) % texture->width;
+	if (tx < 0)
+		tx += texture->width;
+
+	const uint8_t* column = texture->columns + (size_t)tx * texture->height;
+	int th = texture->height;
+
+	// Texels per row, and the texel under the first row's centre
+	float v_step = depth / view->focal;
+	float v = part->v_top + (part->top_height - view->eye_height) - (view->center_y - (y0 + 0.5f)) * v_step;
+	v = fmodf(v, (float)th);
+	if (v < 0.0f)
+		v += th;
+
+	// 16.16 fixed point keeps float to int conversions out of the loop
+	uint32_t frac = (uint32_t)(v * 65536.0f);
+	uint32_t step = (uint32_t)(v_step * 65536.0f);
+	if ((th & (th - 1)) == 0)
+	{
+		uint32_t mask = th - 1;
+		for (int y = y0; y < y1; y++, frac += step)
+			dest[y] = colormap[column[(frac >> 16) & mask]];
+	}
+	else
+	{
+		// Once step is below one texture height a single conditional subtract per row wraps,
+		// doing it before the read also catches a start that rounded up to exactly th
+		uint32_t limit = (uint32_t)th << 16;
+		step %= limit;
+		for (int y = y0; y < y1; y++, frac += step)
+		{
+			frac -= frac >= limit ? limit : 0;
+			dest[y] = colormap[column[frac >> 16]];
+		}
+	}
+}
+
+void draw_flat_column(uint8_t* dest, int y0, int y1, int flat, float plane_height, vec2 position, vec2 ray, int light_level)
+{
+	if (flat < 0 || flat >= num_flat_textures)
+		return;
+
+	const uint8_t* texels = flat_textures[flat].data;
+
+	// depth is plane_height * row_slope[y], so the fade of a row is fade_scale * row_inv_slope[y]
+	int base_row = (15 - (light_level >> 4)) * 4;
+	float fade_scale = LIGHT_FADE / plane_height;
+
+	// Flat tex coords are (x, -y), the offset keeps the truncation a floor
+	int y = y0;
+#ifdef SW_USE_SSE
+	const __m128 height4 = _mm_set1_ps(plane_height), offset4 = _mm_set1_ps(65536.0f);
+	const __m128 px4 = _mm_set1_ps(position.x), py4 = _mm_set1_ps(position.y);
+	const __m128 rx4 = _mm_set1_ps(ray.x), ry4 = _mm_set1_ps(ray.y);
+	const __m128 fade_scale4 = _mm_set1_ps(fade_scale), max_fade4 = _mm_set1_ps(LIGHT_FADE);
+	const __m128i mask4 = _mm_set1_epi32(FLAT_TEXTURE_SIZE - 1), base_row4 = _mm_set1_epi32(base_row);
+	const __m128i min_row8 = _mm_setzero_si128(), max_row8 = _mm_set1_epi16(NUM_LIGHT_COLORMAPS - 1);
+
+	// Four rows at a time up to the texel and colormap fetches, which stay scalar gathers
+	for (; y + 4 <= y1; y += 4)
+	{
+		__m128 depth = _mm_mul_ps(height4, _mm_loadu_ps(row_slope + y));
+		__m128i tx = _mm_cvttps_epi32(_mm_add_ps(_mm_add_ps(px4, _mm_mul_ps(depth, rx4)), offset4));
+		__m128i ty = _mm_cvttps_epi32(_mm_sub_ps(offset4, _mm_add_ps(py4, _mm_mul_ps(depth, ry4))));
+		__m128i texel = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(ty, mask4), FLAT_ROW_SHIFT), _mm_and_si128(tx, mask4));
+
+		__m128 fade = _mm_min_ps(_mm_mul_ps(fade_scale4, _mm_loadu_ps(row_inv_slope + y)), max_fade4);
+		__m128i row = _mm_sub_epi32(base_row4, _mm_cvttps_epi32(fade));
+		row = _mm_packs_epi32(row, row);
+		row = _mm_min_epi16(_mm_max_epi16(row, min_row8), max_row8);
+
+		int32_t texels4[4];
+		int16_t rows8[8];
+		_mm_storeu_si128((__m128i*)texels4, texel);
+		_mm_storeu_si128((__m128i*)rows8, row);
+		for (int i = 0; i < 4; i++)
+			dest[y + i] = colormaps[rows8[i]][texels[texels4[i]]];
+	}
+#endif
+
+	for (; y < y1; y++)
+	{
+		float depth = plane_height * row_slope[y];
+		int tx = (int)(position.x + depth * ray.x + 65536.0f) & (FLAT_TEXTURE_SIZE - 1);
+		int ty = (int)(65536.0f - (position.y + depth * ray.y)) & (FLAT_TEXTURE_SIZE - 1);
+		int row = base_row - (int)fminf(fade_scale * row_inv_slope[y], LIGHT_FADE);
+		row = min(max(row, 0), NUM_LIGHT_COLORMAPS - 1);
+		dest[y] = colormaps[row][texels[ty * FLAT_TEXTURE_SIZE + tx]];
+	}
+}
+
+void draw_sky_column(uint8_t* dest, int y0, int y1, int x, const sw_view* view)
+{
+	if (sky_texture < 0)
+		return;
+
+	const sw_texture* sky = &walls[sky_texture];
+	int tx = (int)column_sky_u[x] % sky->width;
+	const uint8_t* column = sky->columns + (size_t)tx * sky->height;
+
+	float v_step = SKY_FOCAL / view->focal;
+	float v = SKY_TEXTURE_MID + (y0 + 0.5f - view->center_y) * v_step;
+	for (int y = y0; y < y1; y++, v += v_step)
+	{
+		int ty = min(max((int)v, 0), sky->height - 1);
+		dest[y] = column[ty];
+	}
+}
+
+const sw_texture* get_wall(const sw_view* view, int texture)
+{
+	if (texture < 0 || texture >= num_walls)
+		return NULL;
+
+	texture = view->wall_anim[texture];
+	return texture >= 0 && texture < num_walls ? &walls[texture] : NULL;
+}
+
+vec2 get_vertex(uint16_t index)
+{
+	if (index & VERT_IS_GL)
+		return gl_m.vertices[index & ~VERT_IS_GL];
+	return m.vertices[index];
+}
+
+// Same banding as light_row() in the world shaders
+int light_row(int light_level, float depth)
+{
+	int row = (15 - (light_level >> 4)) * 4 - (int)(LIGHT_FADE / fmaxf(depth, 1.0f));
+	return row < 0 ? 0 : row > NUM_LIGHT_COLORMAPS - 1 ? NUM_LIGHT_COLORMAPS - 1 : row;
+}
+
+void free_textures()
+{
+	for (size_t i = 0; i < num_walls; i++)
+		free(walls[i].columns);
+
+	free(walls);
+	walls = NULL;
+	num_walls = 0;
+}
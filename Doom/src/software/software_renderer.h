@@ -0,0 +1,43 @@
+#pragma once
+#include "camera.h"
+#include "palette.h"
+#include "texture/flat_texture.h"
+#include "texture/wall_texture.h"
+
+#include "GLFW/glfw3.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct software_stats
+{
+	int num_threads;
+	float frame_ms; // Wall time of the last frame, drawing and palette conversion
+	float busy_ms;  // Time all threads together spent on the last frame
+	float fps;      // Frames per second the renderer alone sustains
+	float fps_per_core; // Frames per second one fully busy core would sustain
+} software_stats;
+
+// Set with -software. Draws the world on the CPU from the same map, GL nodes and
+// resident textures: a front-to-back BSP walk per vertical screen slice, wall and flat columns
+// into an 8-bit framebuffer lit through COLORMAP, then one palette conversion pass. Slices and
+// the conversion run on the thread pool main starts (-threads N).
+// Nothing here touches a graphics API: frames go to window, created with GLFW_NO_API, through
+// present.h, and headless runs (window NULL) only keep them in memory
+void software_renderer_init(GLFWwindow* window, int width, int height);
+// Prints the averaged benchmark figures
+void software_renderer_shutdown();
+bool software_renderer_is_enabled();
+
+void software_renderer_set_palettes(const palette* palettes, size_t num, const colormap* colormaps, size_t num_colormaps);
+// Takes column-major copies of the resident textures, call again whenever the set grows
+void software_renderer_set_textures(const flat_tex* flats, size_t num_flats, const wall_tex* textures, size_t num_textures);
+
+void software_renderer_draw(const camera* cam, float fov, int palette_index);
+// Shows the last frame in the window, if there is one
+void software_renderer_present();
+// Bottom-up RGBA8 rows of the last frame
+const uint32_t* software_renderer_get_pixels();
+
+software_stats software_renderer_get_stats();
@@ -0,0 +1,87 @@
+#include "stream_buffer.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+static GLuint buffer;
+static uint8_t* mapped;
+static GLsync fences[STREAM_BUFFER_FRAMES];
+static size_t frame_index;
+static size_t frame_offset;
+static bool has_overflowed;
+
+void stream_buffer_init()
+{
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	size_t size = (size_t)STREAM_BUFFER_FRAME_SIZE * STREAM_BUFFER_FRAMES;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+	mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+	if (mapped == NULL)
+		fprintf(stderr, "Stream buffer: failed to map %zu bytes, streamed data is skipped\n", size);
+
+	for (int i = 0; i < STREAM_BUFFER_FRAMES; i++)
+		fences[i] = NULL;
+
+	frame_index = 0;
+	frame_offset = 0;
+}
+
+void stream_buffer_begin_frame()
+{
+	GLsync fence = fences[frame_index];
+	if (fence != NULL)
+	{
+		// Only blocks when the CPU is more than STREAM_BUFFER_FRAMES frames ahead of the GPU
+		GLenum result = glClientWaitSync(fence, 0, 0);
+		while (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED && result != GL_WAIT_FAILED)
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+
+		glDeleteSync(fence);
+		fences[frame_index] = NULL;
+	}
+
+	frame_offset = 0;
+}
+
+void stream_buffer_end_frame()
+{
+	fences[frame_index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame_index = (frame_index + 1) % STREAM_BUFFER_FRAMES;
+}
+
+stream_allocation stream_buffer_alloc(size_t size, size_t alignment)
+{
+	if (mapped == NULL)
+		return (stream_allocation){ NULL, buffer, 0 };
+
+	size_t region = frame_index * STREAM_BUFFER_FRAME_SIZE;
+	size_t offset = region + frame_offset;
+	if (alignment > 1)
+		offset = (offset + alignment - 1) / alignment * alignment;
+
+	if (offset + size > region + STREAM_BUFFER_FRAME_SIZE)
+	{
+		if (!has_overflowed)
+			fprintf(stderr, "Stream buffer: frame region of %d bytes exhausted\n", STREAM_BUFFER_FRAME_SIZE);
+		has_overflowed = true;
+
+		return (stream_allocation){ NULL, buffer, 0 };
+	}
+
+	frame_offset = offset + size - region;
+	return (stream_allocation){ mapped + offset, buffer, offset };
+}
+
+GLuint stream_buffer_get_buffer()
+{
+	return buffer;
+}
+
+size_t stream_buffer_get_frame_usage()
+{
+	return frame_offset;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "glad/glad.h"
+
+#include <stddef.h>
+
+#define STREAM_BUFFER_FRAMES 3
+#define STREAM_BUFFER_FRAME_SIZE (4 * 1024 * 1024)
+
+typedef struct stream_allocation
+{
+	void* data; // NULL when the frame's region is exhausted or the buffer could not be mapped
+	GLuint buffer;
+	size_t offset;
+} stream_allocation;
+
+// One persistently mapped, coherent buffer split into STREAM_BUFFER_FRAMES regions. Each frame
+// sub-allocates linearly from its region, a fence guards the region until the GPU is done with it.
+// Allocations are only valid until the end of the frame they were made in
+void stream_buffer_init();
+void stream_buffer_begin_frame();
+void stream_buffer_end_frame();
+
+stream_allocation stream_buffer_alloc(size_t size, size_t alignment);
+GLuint stream_buffer_get_buffer();
+
+size_t stream_buffer_get_frame_usage();
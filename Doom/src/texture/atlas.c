@@ -0,0 +1,156 @@
+#include "atlas.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct skyline_node
+{
+	int x, y, width;
+} skyline_node;
+
+typedef struct skyline
+{
+	size_t num_nodes;
+	skyline_node* nodes;
+} skyline;
+
+static int compare_heights(const void* a, const void* b);
+static bool find_position(const skyline* line, int page_size, int width, int height, size_t* node_index, int* y);
+static void insert_node(skyline* line, size_t node_index, int x, int y, int width, int height);
+
+static const atlas_rect* sort_rects;
+
+size_t atlas_pack(int page_size, size_t num_rects, atlas_rect* rects)
+{
+	// Tallest first keeps the skyline flat
+	size_t* order = malloc(sizeof(size_t) * (num_rects > 0 ? num_rects : 1));
+	for (size_t i = 0; i < num_rects; i++)
+		order[i] = i;
+
+	sort_rects = rects;
+	qsort(order, num_rects, sizeof(size_t), compare_heights);
+
+	size_t num_pages = 0;
+	skyline* pages = NULL;
+
+	for (size_t i = 0; i < num_rects; i++)
+	{
+		atlas_rect* rect = &rects[order[i]];
+		rect->page = UINT16_MAX;
+		if (rect->width > page_size || rect->height > page_size)
+			continue;
+
+		size_t best_page = num_pages, best_node = 0;
+		int best_y = page_size;
+		for (size_t page = 0; page < num_pages; page++)
+		{
+			size_t node = 0;
+			int y = 0;
+			if (find_position(&pages[page], page_size, rect->width, rect->height, &node, &y) && y < best_y)
+				best_page = page, best_node = node, best_y = y;
+		}
+
+		if (best_page == num_pages)
+		{
+			pages = realloc(pages, sizeof(skyline) * ++num_pages);
+			pages[best_page].nodes = malloc(sizeof(skyline_node) * (page_size + 1));
+			pages[best_page].nodes[0] = (skyline_node){ 0, 0, page_size };
+			pages[best_page].num_nodes = 1;
+
+			best_node = 0;
+			best_y = 0;
+		}
+
+		rect->page = (uint16_t)best_page;
+		rect->x = (uint16_t)pages[best_page].nodes[best_node].x;
+		rect->y = (uint16_t)best_y;
+		insert_node(&pages[best_page], best_node, rect->x, rect->y, rect->width, rect->height);
+	}
+
+	for (size_t i = 0; i < num_pages; i++)
+		free(pages[i].nodes);
+	free(pages);
+	free(order);
+
+	return num_pages;
+}
+
+int compare_heights(const void* a, const void* b)
+{
+	const atlas_rect* ra = &sort_rects[*(const size_t*)a];
+	const atlas_rect* rb = &sort_rects[*(const size_t*)b];
+	if (ra->height != rb->height)
+		return rb->height - ra->height;
+
+	return rb->width - ra->width;
+}
+
+bool find_position(const skyline* line, int page_size, int width, int height, size_t* node_index, int* y)
+{
+	bool found = false;
+	for (size_t i = 0; i < line->num_nodes; i++)
+	{
+		int x = line->nodes[i].x;
+		if (x + width > page_size)
+			break;
+
+		// Resting height is the highest node under the rect
+		int top = 0, remaining = width;
+		for (size_t j = i; remaining > 0; j++)
+		{
+			if (line->nodes[j].y > top)
+				top = line->nodes[j].y;
+			remaining -= line->nodes[j].width;
+		}
+
+		if (top + height <= page_size && (!found || top < *y))
+		{
+			*node_index = i;
+			*y = top;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+void insert_node(skyline* line, size_t node_index, int x, int y, int width, int height)
+{
+	skyline_node* nodes = line->nodes;
+	for (size_t i = line->num_nodes; i > node_index; i--)
+		nodes[i] = nodes[i - 1];
+	nodes[node_index] = (skyline_node){ x, y + height, width };
+	line->num_nodes++;
+
+	// Trim or remove the nodes now covered by the new one
+	size_t i = node_index + 1;
+	while (i < line->num_nodes)
+	{
+		int shrink = nodes[i - 1].x + nodes[i - 1].width - nodes[i].x;
+		if (shrink <= 0)
+			break;
+
+		nodes[i].x += shrink;
+		nodes[i].width -= shrink;
+		if (nodes[i].width > 0)
+			break;
+
+		for (size_t j = i; j + 1 < line->num_nodes; j++)
+			nodes[j] = nodes[j + 1];
+		line->num_nodes--;
+	}
+
+	// Merge neighbours at the same height
+	for (size_t j = 0; j + 1 < line->num_nodes;)
+	{
+		if (nodes[j].y == nodes[j + 1].y)
+		{
+			nodes[j].width += nodes[j + 1].width;
+			for (size_t k = j + 1; k + 1 < line->num_nodes; k++)
+				nodes[k] = nodes[k + 1];
+			line->num_nodes--;
+		}
+		else
+			j++;
+	}
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct atlas_rect
+{
+	uint16_t width, height; // Filled in by the caller
+	uint16_t x, y, page;    // Filled in by atlas_pack
+} atlas_rect;
+
+// Skyline bottom-left packer, places every rect on square pages of page_size texels and
+// returns the number of pages used. Rects larger than a page are not placed (page = UINT16_MAX)
+size_t atlas_pack(int page_size, size_t num_rects, atlas_rect* rects);
@@ -1,6 +1,11 @@
 #include "flat_texture.h"
+#include "texture_upload.h"
 
-GLuint generate_flat_texture_array(const flat_tex* flats, size_t num_flats)
+#include <string.h>
+
+#define FLAT_MIP_LEVELS 7
+
+GLuint generate_flat_texture_array(const flat_tex* flats, size_t num_flats, const palette* palette)
 {
 	GLuint tex_id;
 	glGenTextures(1, &tex_id);
@@ -8,13 +13,50 @@ GLuint generate_flat_texture_array(const flat_tex* flats, size_t num_flats)
 
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R8UI, FLAT_TEXTURE_SIZE, FLAT_TEXTURE_SIZE, num_flats);
+	if (palette == NULL)
+	{
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R8UI, FLAT_TEXTURE_SIZE, FLAT_TEXTURE_SIZE, num_flats);
+	}
+	else
+	{
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, FLAT_MIP_LEVELS, GL_RGBA8, FLAT_TEXTURE_SIZE, FLAT_TEXTURE_SIZE, num_flats);
+	}
 
 	for (int i = 0; i < num_flats; i++)
-		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, FLAT_TEXTURE_SIZE, FLAT_TEXTURE_SIZE, 1, GL_RED_INTEGER, GL_UNSIGNED_BYTE, flats[i].data);
+	{
+		if (palette == NULL)
+		{
+			texture_upload upload = texture_upload_begin(sizeof(flats[i].data));
+			memcpy(upload.data, flats[i].data, sizeof(flats[i].data));
+			texture_upload_commit(&upload, tex_id, GL_RED_INTEGER, 0, 0, i, FLAT_TEXTURE_SIZE, FLAT_TEXTURE_SIZE, 1);
+		}
+		else
+		{
+			texture_upload upload = texture_upload_begin(sizeof(flats[i].data) * 4);
+			palette_expand(palette, flats[i].data, upload.data, sizeof(flats[i].data));
+			texture_upload_commit(&upload, tex_id, GL_RGBA, 0, 0, i, FLAT_TEXTURE_SIZE, FLAT_TEXTURE_SIZE, 1);
+		}
+	}
+	texture_upload_flush();
+
+	if (palette != NULL)
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
 
 	return tex_id;
 }
+
+size_t flat_texture_array_size(size_t num_flats, const palette* palette)
+{
+	if (palette == NULL)
+		return num_flats * FLAT_TEXTURE_SIZE * FLAT_TEXTURE_SIZE;
+
+	size_t layer_texels = 0;
+	for (int level = 0; level < FLAT_MIP_LEVELS; level++)
+		layer_texels += (size_t)(FLAT_TEXTURE_SIZE >> level) * (FLAT_TEXTURE_SIZE >> level);
+	return num_flats * layer_texels * 4;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "glad/glad.h"
+#include "palette.h"
 
 #include <stddef.h>
 #include <stdint.h>
@@ -12,4 +13,7 @@ typedef struct flat_tex
 	char name[9];
 } flat_tex;
 
-GLuint generate_flat_texture_array(const flat_tex* flats, size_t num_flats);
+// Indexed GL_R8UI layers, or mipmapped GL_RGBA8 ones expanded through palette when it is not NULL
+GLuint generate_flat_texture_array(const flat_tex* flats, size_t num_flats, const palette* palette);
+// Bytes generate_flat_texture_array allocates for num_flats flats
+size_t flat_texture_array_size(size_t num_flats, const palette* palette);
@@ -0,0 +1,87 @@
+#include "texture_upload.h"
+
+#include <stdlib.h>
+
+static GLuint pbo;
+static uint8_t* mapped;
+static GLsync fences[TEXTURE_UPLOAD_CHUNKS];
+static size_t chunk;
+static size_t chunk_offset;
+
+static void next_chunk();
+
+void texture_upload_init()
+{
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	size_t size = (size_t)TEXTURE_UPLOAD_CHUNK_SIZE * TEXTURE_UPLOAD_CHUNKS;
+
+	glGenBuffers(1, &pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+	mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	for (int i = 0; i < TEXTURE_UPLOAD_CHUNKS; i++)
+		fences[i] = NULL;
+
+	chunk = 0;
+	chunk_offset = 0;
+}
+
+texture_upload texture_upload_begin(size_t size)
+{
+	if (mapped == NULL || size > TEXTURE_UPLOAD_CHUNK_SIZE)
+		return (texture_upload){ malloc(size), 0, false };
+
+	if (chunk_offset + size > TEXTURE_UPLOAD_CHUNK_SIZE)
+		next_chunk();
+
+	size_t offset = chunk * TEXTURE_UPLOAD_CHUNK_SIZE + chunk_offset;
+	chunk_offset += (size + 3) & ~(size_t)3;
+
+	return (texture_upload){ mapped + offset, offset, true };
+}
+
+void texture_upload_commit(texture_upload* upload, GLuint texture, GLenum format, int x, int y, int z, int width, int height, int depth)
+{
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	if (upload->is_staged)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		glTextureSubImage3D(texture, 0, x, y, z, width, height, depth, format, GL_UNSIGNED_BYTE, (const void*)upload->offset);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	else
+	{
+		glTextureSubImage3D(texture, 0, x, y, z, width, height, depth, format, GL_UNSIGNED_BYTE, upload->data);
+		free(upload->data);
+	}
+
+	upload->data = NULL;
+}
+
+void texture_upload_flush()
+{
+	if (chunk_offset > 0)
+		next_chunk();
+}
+
+void next_chunk()
+{
+	fences[chunk] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	chunk = (chunk + 1) % TEXTURE_UPLOAD_CHUNKS;
+	chunk_offset = 0;
+
+	GLsync fence = fences[chunk];
+	if (fence == NULL)
+		return;
+
+	// Only blocks when the copies out of this chunk are still in flight
+	GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	while (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED && result != GL_WAIT_FAILED)
+		result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+
+	glDeleteSync(fence);
+	fences[chunk] = NULL;
+}
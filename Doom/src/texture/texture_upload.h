@@ -0,0 +1,28 @@
+#pragma once
+#include "glad/glad.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TEXTURE_UPLOAD_CHUNKS 4
+#define TEXTURE_UPLOAD_CHUNK_SIZE (1024 * 1024)
+
+typedef struct texture_upload
+{
+	uint8_t* data; // Write the texels here before committing
+	size_t offset;
+	bool is_staged; // False when the request did not fit in a chunk and lives in client memory
+} texture_upload;
+
+// Texel data is composed straight into a persistently mapped pixel unpack buffer and copied
+// into the texture by the driver while the CPU moves on to the next layer. The buffer is split
+// into TEXTURE_UPLOAD_CHUNKS chunks, each guarded by a fence once the allocator leaves it
+void texture_upload_init();
+
+texture_upload texture_upload_begin(size_t size);
+// Copies a region into any texture target (2D array layers, cubemap faces), format is
+// GL_RED_INTEGER for indexed textures or GL_RGBA for true-color ones
+void texture_upload_commit(texture_upload* upload, GLuint texture, GLenum format, int x, int y, int z, int width, int height, int depth);
+// Fences the current chunk so the copies queued so far get submitted
+void texture_upload_flush();
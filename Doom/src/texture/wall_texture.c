@@ -1,43 +1,140 @@
 #include "wall_texture.h"
+#include "texture_upload.h"
+#include "atlas.h"
+#include "utils.h"
 
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-GLuint generate_wall_texture_array(const wall_tex* textures, size_t num_textures, vec2* max_coords_array)
+void generate_wall_atlas(const wall_tex* textures, size_t num_textures, const palette* palette, wall_atlas* atlas)
 {
-    vec2 max_size = { 0.f, 0.f };
-    vec2 min_size = { INFINITY, INFINITY };
+    // True-color pages are filtered and mipmapped, so each rect gets a border of wrapped texels
+    // and starts on a multiple of the gutter to keep it aligned down the mip chain
+    int gutter = palette != NULL ? WALL_ATLAS_GUTTER : 0;
+    int levels = palette != NULL ? WALL_ATLAS_MIP_LEVELS : 1;
+    int texel_size = palette != NULL ? 4 : 1;
+
+    int max_width = 0, max_height = 0;
+    for (int i = 0; i < num_textures; i++)
+    {
+        if (max_width < textures[i].width) max_width = textures[i].width;
+        if (max_height < textures[i].height) max_height = textures[i].height;
+    }
+
+    int page_size = WALL_ATLAS_PAGE_SIZE;
+    while (page_size < max_width + 2 * gutter || page_size < max_height + 2 * gutter)
+        page_size *= 2;
+
+    atlas_rect* rects = malloc(sizeof(atlas_rect) * (num_textures > 0 ? num_textures : 1));
     for (int i = 0; i < num_textures; i++)
     {
-        if (max_size.x < textures[i].width) max_size.x = textures[i].width;
-        if (max_size.y < textures[i].height) max_size.y = textures[i].height;
-        if (min_size.x > textures[i].width) min_size.x = textures[i].width;
-        if (min_size.y > textures[i].height) min_size.y = textures[i].height;
+        int width = textures[i].width + 2 * gutter;
+        int height = textures[i].height + 2 * gutter;
+        if (gutter > 0)
+        {
+            width = (width + gutter - 1) / gutter * gutter;
+            height = (height + gutter - 1) / gutter * gutter;
+        }
+
+        rects[i] = (atlas_rect){ width, height };
     }
 
+    size_t num_pages = atlas_pack(page_size, num_textures, rects);
+
     GLuint tex_id;
     glGenTextures(1, &tex_id);
     glBindTexture(GL_TEXTURE_2D_ARRAY, tex_id);
 
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    if (palette == NULL)
+    {
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    else
+    {
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
 
-    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R8UI, max_size.x, max_size.y, num_textures);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, palette != NULL ? GL_RGBA8 : GL_R8UI, page_size, page_size, num_pages > 0 ? num_pages : 1);
 
+    int32_t* rect_data = malloc(sizeof(int32_t) * 4 * (num_textures > 0 ? num_textures : 1));
     for (int i = 0; i < num_textures; i++)
     {
-        max_coords_array[i] = (vec2){
-            textures[i].width / max_size.x,
-            textures[i].height / max_size.y
-        };
+        const wall_tex* texture = &textures[i];
+        const atlas_rect* rect = &rects[i];
+        rect_data[i * 4 + 0] = rect->x + gutter;
+        rect_data[i * 4 + 1] = rect->y + gutter;
+        rect_data[i * 4 + 2] = rect->page;
+        rect_data[i * 4 + 3] = texture->width | (texture->height << 16);
 
-        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, textures[i].width, textures[i].height, 1, GL_RED_INTEGER, GL_UNSIGNED_BYTE, textures[i].data);
+        if (palette == NULL)
+        {
+            size_t size = texture->width * texture->height;
+            texture_upload upload = texture_upload_begin(size);
+            memcpy(upload.data, texture->data, size);
+            texture_upload_commit(&upload, tex_id, GL_RED_INTEGER, rect->x, rect->y, rect->page, texture->width, texture->height, 1);
+            continue;
+        }
+
+        texture_upload upload = texture_upload_begin((size_t)rect->width * rect->height * 4);
+        for (int y = 0; y < rect->height; y++)
+        {
+            int src_y = ((y - gutter) % texture->height + texture->height) % texture->height;
+            for (int x = 0; x < rect->width; x++)
+            {
+                int src_x = ((x - gutter) % texture->width + texture->width) % texture->width;
+                palette_expand(palette, &texture->data[src_y * texture->width + src_x], &upload.data[(y * rect->width + x) * 4], 1);
+            }
+        }
+        texture_upload_commit(&upload, tex_id, GL_RGBA, rect->x, rect->y, rect->page, rect->width, rect->height, 1);
     }
+    texture_upload_flush();
 
-    return tex_id;
+    if (palette != NULL)
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+    glGenBuffers(1, &atlas->rects_buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, atlas->rects_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(int32_t) * 4 * (num_textures > 0 ? num_textures : 1), rect_data, GL_STATIC_DRAW);
+
+    glGenTextures(1, &atlas->rects);
+    glBindTexture(GL_TEXTURE_BUFFER, atlas->rects);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32I, atlas->rects_buffer);
+
+    atlas->texture = tex_id;
+    atlas->page_size = page_size;
+    atlas->num_pages = num_pages;
+
+    size_t used_texels = 0;
+    for (size_t i = 0; i < num_textures; i++)
+        used_texels += (size_t)textures[i].width * textures[i].height;
+    size_t page_texels = 0;
+    for (int level = 0; level < levels; level++)
+        page_texels += (size_t)(page_size >> level) * (page_size >> level);
+    // The mip chain adds the same fraction to the textures as to the pages
+    atlas->allocated_bytes = page_texels * num_pages * texel_size;
+    atlas->used_bytes = (size_t)((double)used_texels * page_texels / ((double)page_size * page_size)) * texel_size;
+
+    // Compared against one max-size layer per texture
+    double mb = 1024.0 * 1024.0;
+    double array_size = (double)max_width * max_height * num_textures * texel_size / mb;
+    double atlas_size = (double)page_size * page_size * num_pages * texel_size / mb;
+    printf("Wall atlas: %zu textures on %zu pages of %dx%d, %.1f MB (array layout %.1f MB, saved %.1f MB)\n",
+        num_textures, num_pages, page_size, page_size, atlas_size, array_size, array_size - atlas_size);
+
+    free(rect_data);
+    free(rects);
+}
+
+void free_wall_atlas(wall_atlas* atlas)
+{
+    glDeleteTextures(1, &atlas->texture);
+    glDeleteTextures(1, &atlas->rects);
+    glDeleteBuffers(1, &atlas->rects_buffer);
+    *atlas = (wall_atlas){ 0 };
 }
 
 GLuint generate_texture_cubemap(const wall_tex* texture)
@@ -52,21 +149,25 @@ GLuint generate_texture_cubemap(const wall_tex* texture)
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
     uint32_t size = max(texture->width, texture->height);
-    uint8_t* data = malloc(size * size);
-    memset(data, 0, size * size);
-    memcpy(data + (size * size - texture->width * texture->height) / 3, texture->data, texture->width * texture->height);
-    memset(data, texture->data[0], (size * size - texture->width * texture->height) / 3);
+    size_t face_size = size * size;
+    size_t fill = (face_size - texture->width * texture->height) / 3;
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, GL_R8UI, size, size);
 
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_R8UI, size, size, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, data);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, 0, GL_R8UI, size, size, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, data);
+    // All six faces are composed in place (+X, -X, +Y, -Y, +Z, -Z) and copied with one call
+    texture_upload upload = texture_upload_begin(face_size * 6);
+    uint8_t* side = upload.data;
+    memset(side, 0, face_size);
+    memcpy(side + fill, texture->data, texture->width * texture->height);
+    memset(side, texture->data[0], fill);
 
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, GL_R8UI, size, size, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, data);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, GL_R8UI, size, size, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, data);
+    memcpy(upload.data + face_size, side, face_size);
+    memset(upload.data + face_size * 2, texture->data[0], face_size);
+    memset(upload.data + face_size * 3, 0, face_size);
+    memcpy(upload.data + face_size * 4, side, face_size);
+    memcpy(upload.data + face_size * 5, side, face_size);
 
-    memset(data, texture->data[0], size * size);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, 0, GL_R8UI, size, size, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, data);
-    memset(data, 0, size * size);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, 0, GL_R8UI, size, size, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, data);
+    texture_upload_commit(&upload, tex_id, GL_RED_INTEGER, 0, 0, 0, size, size, 6);
+    texture_upload_flush();
 
     return tex_id;
 }
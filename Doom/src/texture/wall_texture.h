@@ -1,6 +1,7 @@
 #pragma once
 #include "math/vector.h"
 #include "glad/glad.h"
+#include "palette.h"
 
 #include <stdint.h>
 #include <stddef.h>
@@ -12,5 +13,22 @@ typedef struct wall_tex
 	uint8_t* data;
 } wall_tex;
 
-GLuint generate_wall_texture_array(const wall_tex* textures, size_t num_textures, vec2* max_coords_array);
+#define WALL_ATLAS_PAGE_SIZE 1024
+#define WALL_ATLAS_GUTTER 8
+#define WALL_ATLAS_MIP_LEVELS 4 // Down to one texel of gutter
+
+// Wall textures packed onto the layers of a 2D array texture, rects holds one
+// (x, y, page, width | height << 16) texel per texture for the shaders
+typedef struct wall_atlas
+{
+	GLuint texture, rects, rects_buffer;
+	int page_size;
+	size_t num_pages;
+	// Texels of the textures themselves and of the whole pages, mip chains included
+	size_t used_bytes, allocated_bytes;
+} wall_atlas;
+
+// Indexed GL_R8UI pages, or mipmapped GL_RGBA8 ones expanded through palette when it is not NULL
+void generate_wall_atlas(const wall_tex* textures, size_t num_textures, const palette* palette, wall_atlas* atlas);
+void free_wall_atlas(wall_atlas* atlas);
 GLuint generate_texture_cubemap(const wall_tex* texture);
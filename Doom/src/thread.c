@@ -0,0 +1,236 @@
+#include "thread.h"
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+struct thread
+{
+	HANDLE handle;
+	thread_func func;
+	void* data;
+	int result;
+};
+
+struct thread_mutex
+{
+	CRITICAL_SECTION section;
+};
+
+struct thread_cond
+{
+	CONDITION_VARIABLE variable;
+};
+
+static DWORD WINAPI thread_entry(LPVOID param)
+{
+	thread* t = param;
+	t->result = t->func(t->data);
+	return 0;
+}
+
+thread* thread_create(thread_func func, void* data)
+{
+	thread* t = malloc(sizeof(thread));
+	t->func = func;
+	t->data = data;
+	t->result = 0;
+	t->handle = CreateThread(NULL, 0, thread_entry, t, 0, NULL);
+	if (t->handle == NULL)
+	{
+		free(t);
+		return NULL;
+	}
+
+	return t;
+}
+
+int thread_join(thread* t)
+{
+	WaitForSingleObject(t->handle, INFINITE);
+	CloseHandle(t->handle);
+	int result = t->result;
+	free(t);
+	return result;
+}
+
+thread_mutex* thread_mutex_create()
+{
+	thread_mutex* mutex = malloc(sizeof(thread_mutex));
+	InitializeCriticalSection(&mutex->section);
+	return mutex;
+}
+
+void thread_mutex_destroy(thread_mutex* mutex)
+{
+	DeleteCriticalSection(&mutex->section);
+	free(mutex);
+}
+
+void thread_mutex_lock(thread_mutex* mutex)
+{
+	EnterCriticalSection(&mutex->section);
+}
+
+void thread_mutex_unlock(thread_mutex* mutex)
+{
+	LeaveCriticalSection(&mutex->section);
+}
+
+thread_cond* thread_cond_create()
+{
+	thread_cond* cond = malloc(sizeof(thread_cond));
+	InitializeConditionVariable(&cond->variable);
+	return cond;
+}
+
+void thread_cond_destroy(thread_cond* cond)
+{
+	free(cond);
+}
+
+void thread_cond_wait(thread_cond* cond, thread_mutex* mutex)
+{
+	SleepConditionVariableCS(&cond->variable, &mutex->section, INFINITE);
+}
+
+void thread_cond_signal(thread_cond* cond)
+{
+	WakeConditionVariable(&cond->variable);
+}
+
+void thread_cond_broadcast(thread_cond* cond)
+{
+	WakeAllConditionVariable(&cond->variable);
+}
+
+void thread_yield()
+{
+	SwitchToThread();
+}
+
+int thread_get_num_cores()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+struct thread
+{
+	pthread_t handle;
+	thread_func func;
+	void* data;
+	int result;
+};
+
+struct thread_mutex
+{
+	pthread_mutex_t mutex;
+};
+
+struct thread_cond
+{
+	pthread_cond_t cond;
+};
+
+static void* thread_entry(void* param)
+{
+	thread* t = param;
+	t->result = t->func(t->data);
+	return NULL;
+}
+
+thread* thread_create(thread_func func, void* data)
+{
+	thread* t = malloc(sizeof(thread));
+	t->func = func;
+	t->data = data;
+	t->result = 0;
+	if (pthread_create(&t->handle, NULL, thread_entry, t) != 0)
+	{
+		free(t);
+		return NULL;
+	}
+
+	return t;
+}
+
+int thread_join(thread* t)
+{
+	pthread_join(t->handle, NULL);
+	int result = t->result;
+	free(t);
+	return result;
+}
+
+thread_mutex* thread_mutex_create()
+{
+	thread_mutex* mutex = malloc(sizeof(thread_mutex));
+	pthread_mutex_init(&mutex->mutex, NULL);
+	return mutex;
+}
+
+void thread_mutex_destroy(thread_mutex* mutex)
+{
+	pthread_mutex_destroy(&mutex->mutex);
+	free(mutex);
+}
+
+void thread_mutex_lock(thread_mutex* mutex)
+{
+	pthread_mutex_lock(&mutex->mutex);
+}
+
+void thread_mutex_unlock(thread_mutex* mutex)
+{
+	pthread_mutex_unlock(&mutex->mutex);
+}
+
+thread_cond* thread_cond_create()
+{
+	thread_cond* cond = malloc(sizeof(thread_cond));
+	pthread_cond_init(&cond->cond, NULL);
+	return cond;
+}
+
+void thread_cond_destroy(thread_cond* cond)
+{
+	pthread_cond_destroy(&cond->cond);
+	free(cond);
+}
+
+void thread_cond_wait(thread_cond* cond, thread_mutex* mutex)
+{
+	pthread_cond_wait(&cond->cond, &mutex->mutex);
+}
+
+void thread_cond_signal(thread_cond* cond)
+{
+	pthread_cond_signal(&cond->cond);
+}
+
+void thread_cond_broadcast(thread_cond* cond)
+{
+	pthread_cond_broadcast(&cond->cond);
+}
+
+void thread_yield()
+{
+	sched_yield();
+}
+
+int thread_get_num_cores()
+{
+	long num = sysconf(_SC_NPROCESSORS_ONLN);
+	return num > 0 ? (int)num : 1;
+}
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+// Minimal portable threading, Win32 threads on Windows and pthreads everywhere else.
+// All objects are heap allocated so the platform headers stay out of this one
+typedef struct thread thread;
+typedef struct thread_mutex thread_mutex;
+typedef struct thread_cond thread_cond;
+
+typedef int (*thread_func)(void* data);
+
+thread* thread_create(thread_func func, void* data);
+// Waits for the thread to finish and frees it, returns the value func returned
+int thread_join(thread* thread);
+
+thread_mutex* thread_mutex_create();
+void thread_mutex_destroy(thread_mutex* mutex);
+void thread_mutex_lock(thread_mutex* mutex);
+void thread_mutex_unlock(thread_mutex* mutex);
+
+thread_cond* thread_cond_create();
+void thread_cond_destroy(thread_cond* cond);
+void thread_cond_wait(thread_cond* cond, thread_mutex* mutex);
+void thread_cond_signal(thread_cond* cond);
+void thread_cond_broadcast(thread_cond* cond);
+
+// Gives up the rest of the calling thread's time slice
+void thread_yield();
+
+// Number of logical processors, at least 1
+int thread_get_num_cores();
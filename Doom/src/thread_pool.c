@@ -0,0 +1,135 @@
+#include "thread_pool.h"
+#include "thread.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+static thread** workers;
+static int num_workers;
+static thread_mutex* mutex;
+static thread_cond* work_cond;
+static thread_cond* done_cond;
+
+// Current batch, guarded by mutex
+static thread_pool_job batch_job;
+static void* batch_data;
+static int batch_size;
+static int next_job;
+static int num_done;
+static unsigned int generation;
+static bool is_shutting_down;
+
+static int worker_main(void* data);
+static void run_jobs();
+
+void thread_pool_init(int num_threads)
+{
+	num_workers = num_threads > 1 ? num_threads - 1 : 0;
+	mutex = thread_mutex_create();
+	work_cond = thread_cond_create();
+	done_cond = thread_cond_create();
+	is_shutting_down = false;
+	generation = 0;
+	batch_size = next_job = num_done = 0;
+
+	workers = malloc(sizeof(thread*) * (num_workers > 0 ? num_workers : 1));
+	for (int i = 0; i < num_workers; i++)
+	{
+		workers[i] = thread_create(worker_main, NULL);
+		if (workers[i] == NULL)
+		{
+			num_workers = i;
+			break;
+		}
+	}
+}
+
+void thread_pool_shutdown()
+{
+	thread_mutex_lock(mutex);
+	is_shutting_down = true;
+	thread_cond_broadcast(work_cond);
+	thread_mutex_unlock(mutex);
+
+	for (int i = 0; i < num_workers; i++)
+		thread_join(workers[i]);
+
+	free(workers);
+	workers = NULL;
+	num_workers = 0;
+	thread_cond_destroy(done_cond);
+	thread_cond_destroy(work_cond);
+	thread_mutex_destroy(mutex);
+}
+
+void thread_pool_run(thread_pool_job job, void* data, int num_jobs)
+{
+	if (num_jobs <= 0)
+		return;
+
+	if (num_workers == 0)
+	{
+		for (int i = 0; i < num_jobs; i++)
+			job(data, i);
+		return;
+	}
+
+	thread_mutex_lock(mutex);
+	batch_job = job;
+	batch_data = data;
+	batch_size = num_jobs;
+	next_job = 0;
+	num_done = 0;
+	generation++;
+	thread_cond_broadcast(work_cond);
+
+	run_jobs();
+	while (num_done < batch_size)
+		thread_cond_wait(done_cond, mutex);
+
+	thread_mutex_unlock(mutex);
+}
+
+int thread_pool_get_num_threads()
+{
+	return num_workers + 1;
+}
+
+int worker_main(void* data)
+{
+	unsigned int seen_generation = 0;
+
+	thread_mutex_lock(mutex);
+	while (true)
+	{
+		while (!is_shutting_down && generation == seen_generation)
+			thread_cond_wait(work_cond, mutex);
+
+		if (is_shutting_down)
+			break;
+
+		seen_generation = generation;
+		run_jobs();
+	}
+	thread_mutex_unlock(mutex);
+
+	return 0;
+}
+
+// Called with the mutex held, drops it around every job
+void run_jobs()
+{
+	while (next_job < batch_size)
+	{
+		int index = next_job++;
+		thread_pool_job job = batch_job;
+		void* data = batch_data;
+
+		thread_mutex_unlock(mutex);
+		job(data, index);
+		thread_mutex_lock(mutex);
+
+		if (++num_done == batch_size)
+			thread_cond_signal(done_cond);
+	}
+}
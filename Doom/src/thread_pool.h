@@ -0,0 +1,13 @@
+#pragma once
+
+typedef void (*thread_pool_job)(void* data, int index);
+
+// Fixed set of worker threads that run indexed jobs. num_threads counts the calling thread,
+// which works through the jobs too, so 1 runs everything inline without spawning anything
+void thread_pool_init(int num_threads);
+void thread_pool_shutdown();
+
+// Calls job(data, i) for every i in [0, num_jobs) spread over the pool, returns when all are done
+void thread_pool_run(thread_pool_job job, void* data, int num_jobs);
+
+int thread_pool_get_num_threads();
@@ -0,0 +1,4 @@
+#pragma once
+
+// Monotonic clock in seconds that does not depend on a window system being initialized
+double timer_now();
@@ -2,21 +2,16 @@
 
 #include <ctype.h>
 #include <stddef.h>
+#include <stdlib.h>
 
-// NOTE: DEPRECATED! Damned MSVC doesn't have support for generic types so instead I will use stdlib.h for this functions
-//#define max(x, y)              \
-//    ({                         \
-//      __typeof__ __x = (x);    \
-//      __typeof__ __y = (y);    \
-//      __x > __y ? __x : __y;   \
-//    })
-//
-//#define min(x, y)              \
-//    ({                         \
-//      __typeof__ __x = (x);    \
-//      __typeof__ __y = (y);    \
-//      __x < __y ? __x : __y;   \
-//    })
+// MSVC's stdlib.h already has these, other compilers get them here
+#ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
 
 static inline int strcmp_nocase(const char* str1, const char* str2)
 {
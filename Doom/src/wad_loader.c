@@ -60,6 +60,24 @@ int wad_load_from_file(const char* filename, wad* wad)
 	return 0;
 }
 
+int wad_add_file(const char* filename, wad* wad)
+{
+	struct wad pwad;
+	int result = wad_load_from_file(filename, &pwad);
+	if (result != 0)
+		return result;
+
+	wad->lumps = realloc(wad->lumps, sizeof(lump) * (wad->num_lumps + pwad.num_lumps));
+	memmove(wad->lumps + pwad.num_lumps, wad->lumps, sizeof(lump) * wad->num_lumps);
+	memcpy(wad->lumps, pwad.lumps, sizeof(lump) * pwad.num_lumps);
+	wad->num_lumps += pwad.num_lumps;
+
+	// The lumps now belong to wad
+	free(pwad.id);
+	free(pwad.lumps);
+	return 0;
+}
+
 void wad_free(wad* wad)
 {
 	if (wad == NULL)
@@ -101,6 +119,21 @@ palette* wad_read_playpal(size_t* num, const wad* wad)
 	return palettes;
 }
 
+colormap* wad_read_colormaps(size_t* num, const wad* wad)
+{
+	int colormap_index = wad_find_lump("COLORMAP", wad);
+	if (colormap_index < 0)
+		return NULL;
+
+	*num = wad->lumps[colormap_index].size / NUM_COLORS;
+
+	colormap* colormaps = malloc(sizeof(colormap) * *num);
+	for (int i = 0; i < *num; i++)
+		memcpy(colormaps[i].indices, wad->lumps[colormap_index].data + i * NUM_COLORS, NUM_COLORS);
+
+	return colormaps;
+}
+
 flat_tex* wad_read_flats(size_t* num, const wad* wad)
 {
 	int f_start = wad_find_lump("F_START", wad);
@@ -192,6 +225,8 @@ void wad_free_patches(patch* patches, size_t num)
 	}
 }
 
+static void blit_patch(wall_tex* texture, const patch* patch, int origin_x, int origin_y);
+
 wall_tex* wad_read_textures(size_t* num, const char* lumpname, const wad* wad)
 {
 	size_t num_patches;
@@ -219,20 +254,7 @@ wall_tex* wad_read_textures(size_t* num, const char* lumpname, const wad* wad)
 			int16_t origin_y = READ_I16(tex_lump->data, offset + 24 + j * 10);
 			uint16_t patch_index = READ_I16(tex_lump->data, offset + 26 + j * 10);
 
-			patch patch = patches[patch_index];
-			for (int x = 0; x < patch.width; x++)
-			{
-				for (int y = 0; y < patch.height; y++)
-				{
-					uint8_t data_byte = patch.data[y * patch.width + x];
-					int tex_x = x + origin_x;
-					int tex_y = y + origin_y;
-
-					if (tex_x >= 0 && tex_x < textures[i].width &&
-						tex_y >= 0 && tex_y < textures[i].height && data_byte != 247)
-						textures[i].data[tex_y * textures[i].width + tex_x] = data_byte;
-				}
-			}
+			blit_patch(&textures[i], &patches[patch_index], origin_x, origin_y);
 		}
 	}
 
@@ -240,6 +262,100 @@ wall_tex* wad_read_textures(size_t* num, const char* lumpname, const wad* wad)
 	return textures;
 }
 
+wall_tex* wad_read_texture_defs(size_t* num, const char* lumpname, const wad* wad)
+{
+	int lump_index = wad_find_lump(lumpname, wad);
+	if (lump_index < 0)
+		return NULL;
+
+	lump* tex_lump = &wad->lumps[lump_index];
+	*num = READ_I32(tex_lump->data, 0);
+
+	wall_tex* textures = malloc(sizeof(wall_tex) * *num);
+	for (int i = 0; i < *num; i++)
+	{
+		uint32_t offset = READ_I32(tex_lump->data, 4 * i + 4);
+		memcpy(textures[i].name, tex_lump->data + offset, 8);
+		textures[i].width = READ_I16(tex_lump->data, offset + 12);
+		textures[i].height = READ_I16(tex_lump->data, offset + 14);
+		textures[i].data = NULL;
+	}
+
+	return textures;
+}
+
+int wad_compose_texture(wall_tex* texture, size_t index, const char* lumpname, const wad* wad)
+{
+	int lump_index = wad_find_lump(lumpname, wad);
+	int pnames_index = wad_find_lump("PNAMES", wad);
+	if (lump_index < 0 || pnames_index < 0)
+		return 1;
+
+	lump* tex_lump = &wad->lumps[lump_index];
+	lump* pnames_lump = &wad->lumps[pnames_index];
+	uint32_t offset = READ_I32(tex_lump->data, 4 * index + 4);
+
+	texture->data = malloc(texture->width * texture->height);
+	memset(texture->data, 247, texture->width * texture->height);
+
+	// Only the patches this texture uses are decoded
+	uint16_t num_patches = READ_I16(tex_lump->data, offset + 20);
+	for (int j = 0; j < num_patches; j++)
+	{
+		int16_t origin_x = READ_I16(tex_lump->data, offset + 22 + j * 10);
+		int16_t origin_y = READ_I16(tex_lump->data, offset + 24 + j * 10);
+		uint16_t patch_index = READ_I16(tex_lump->data, offset + 26 + j * 10);
+
+		char patch_name[9] = { 0 };
+		memcpy(patch_name, &pnames_lump->data[patch_index * 8 + 4], 8);
+
+		patch patch;
+		if (wad_read_patch(&patch, patch_name, wad) != 0)
+			continue;
+
+		blit_patch(texture, &patch, origin_x, origin_y);
+		free(patch.data);
+	}
+
+	return 0;
+}
+
+int wad_read_flat(flat_tex* flat, size_t index, const wad* wad)
+{
+	int f_start = wad_find_lump("F_START", wad);
+	int f_end = wad_find_lump("F_END", wad);
+	int lump_index = f_start + 1 + (int)index;
+	if (f_start < 0 || lump_index >= f_end)
+		return 1;
+
+	const lump* flat_lump = &wad->lumps[lump_index];
+	if (flat_lump->size != FLAT_TEXTURE_SIZE * FLAT_TEXTURE_SIZE)
+		return 1;
+
+	memset(flat->name, 0, sizeof(flat->name));
+	memcpy(flat->name, flat_lump->name, 8);
+	memcpy(flat->data, flat_lump->data, FLAT_TEXTURE_SIZE * FLAT_TEXTURE_SIZE);
+
+	return 0;
+}
+
+void blit_patch(wall_tex* texture, const patch* patch, int origin_x, int origin_y)
+{
+	for (int x = 0; x < patch->width; x++)
+	{
+		for (int y = 0; y < patch->height; y++)
+		{
+			uint8_t data_byte = patch->data[y * patch->width + x];
+			int tex_x = x + origin_x;
+			int tex_y = y + origin_y;
+
+			if (tex_x >= 0 && tex_x < texture->width &&
+				tex_y >= 0 && tex_y < texture->height && data_byte != 247)
+				texture->data[tex_y * texture->width + tex_x] = data_byte;
+		}
+	}
+}
+
 void wad_free_wall_textures(wall_tex* textures, size_t num)
 {
 	for (int i = 0; i < num; i++)
@@ -288,6 +404,11 @@ void wad_free_map(map* map)
 	free(map->sectors);
 	free(map->linedefs);
 	free(map->sidedefs);
+	map->vertices = NULL;
+	map->things = NULL;
+	map->sectors = NULL;
+	map->linedefs = NULL;
+	map->sidedefs = NULL;
 }
 
 #define GL_VERTICES_IDX 1
@@ -320,10 +441,15 @@ int wad_read_gl_map(const char* gl_mapname, gl_map* map, const wad* wad)
 
 void wad_free_gl_map(gl_map* map)
 {
-	map->num_vertices = map->num_segments = map->num_subsectors = 0;
+	map->num_vertices = map->num_segments = map->num_subsectors = map->num_nodes = 0;
 	free(map->vertices);
 	free(map->segments);
 	free(map->subsectors);
+	free(map->nodes);
+	map->vertices = NULL;
+	map->segments = NULL;
+	map->subsectors = NULL;
+	map->nodes = NULL;
 }
 
 void read_gl_vertices(gl_map* map, const lump* lump)
@@ -24,6 +24,8 @@ typedef struct wad
 } wad;
 
 int wad_load_from_file(const char* filename, wad* wad);
+// Loads a PWAD in front of the lumps already loaded so its maps and lumps win every lookup
+int wad_add_file(const char* filename, wad* wad);
 void wad_free(wad* wad);
 
 int wad_find_lump(const char* lumpname, const wad* wad);
@@ -32,10 +34,17 @@ int wad_read_gl_map(const char* gl_mapname, gl_map* map, const wad* wad);
 
 int wad_read_patch(patch* patch, const char* patch_name, const wad* wad);
 palette* wad_read_playpal(size_t* num, const wad* wad);
+colormap* wad_read_colormaps(size_t* num, const wad* wad);
 flat_tex* wad_read_flats(size_t* num, const wad* wad);
 patch* wad_read_patches(size_t* num, const wad* wad);
 wall_tex* wad_read_textures(size_t* num, const char* lumpname, const wad* wad);
 
+// Names and sizes only, data stays NULL until wad_compose_texture
+wall_tex* wad_read_texture_defs(size_t* num, const char* lumpname, const wad* wad);
+int wad_compose_texture(wall_tex* texture, size_t index, const char* lumpname, const wad* wad);
+// index counts lumps after F_START, the same numbering sectors use
+int wad_read_flat(flat_tex* flat, size_t index, const wad* wad);
+
 void wad_free_map(map* map);
 void wad_free_gl_map(gl_map* map);
 void wad_free_patches(patch* patches, size_t num);
@@ -0,0 +1,44 @@
+project "MapGen"
+    kind "ConsoleApp"
+    language "C"
+    cdialect "C17"
+    staticruntime "off"
+
+    files
+    {
+        "src/**.h",
+        "src/**.c",
+        "%{wks.location}/Doom/src/args.h",
+        "%{wks.location}/Doom/src/args.c",
+        "%{wks.location}/Doom/src/utils.h"
+    }
+
+    defines
+    {
+        "_CRT_SECURE_NO_WARNINGS"
+    }
+
+    includedirs
+    {
+        "src",
+        "%{wks.location}/Doom/src"
+    }
+
+    targetdir ("%{wks.location}/bin/" .. outputdir .. "/%{prj.name}")
+    objdir ("%{wks.location}/bin-int/" .. outputdir .. "/%{prj.name}")
+
+    filter "system:windows"
+        systemversion "latest"
+
+    filter "system:linux"
+        links { "m" }
+
+    filter "configurations:Debug"
+        defines { "DEBUG" }
+        runtime "Debug"
+        symbols "On"
+
+    filter "configurations:Release"
+        defines { "RELEASE" }
+        runtime "Release"
+        optimize "On"
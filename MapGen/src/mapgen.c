@@ -0,0 +1,714 @@
+#include "args.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_OUTPUT "synthetic.wad"
+#define DEFAULT_MAPNAME "MAP01"
+#define DEFAULT_SECTORS 256
+#define DEFAULT_CELL_SIZE 256
+#define DEFAULT_WALL "STARTAN3"
+#define DEFAULT_FLOOR "FLOOR4_8"
+#define DEFAULT_CEILING "CEIL3_5"
+
+#define MAX_VERTICES 0x7fff	// Bit 15 of a GL seg vertex marks a GL vertex
+#define MAX_INDEX 0xfffe	// 0xffff means "none" for linedefs and sidedefs
+#define MAX_SUBSECTORS 0x7fff	// Bit 15 of a child marks a subsector
+#define MAX_COORDINATE 32767
+#define BLOCK_SIZE 128
+#define MIN_CELL_SIZE 16
+#define MAX_LUMPS 32
+
+#define THING_P1_START 1
+#define THING_FLAGS_ALL_SKILLS 7
+#define LINEDEF_FLAGS_IMPASSABLE 0x0001
+#define LINEDEF_FLAGS_TWO_SIDED 0x0004
+#define NO_INDEX 0xffff
+
+typedef struct buffer
+{
+	uint8_t* data;
+	size_t size, capacity;
+} buffer;
+
+typedef struct out_lump
+{
+	char name[8];
+	buffer data;
+} out_lump;
+
+typedef struct line
+{
+	uint16_t v1, v2;
+	uint16_t front, back;	// Sector indices, NO_INDEX for the back of a one-sided line
+} line;
+
+static bool is_cell_size_valid(int cell_size, int pieces);
+static uint16_t corner(int i, int j);
+static uint16_t vertical_vertex(int i, int j, int p);
+static uint16_t horizontal_vertex(int i, int j, int p);
+static int vertical_line(int i, int j, int p);
+static int horizontal_line(int i, int j, int p);
+static void build_vertices();
+static void build_lines();
+static void add_seg(int index, int line_index, int side);
+static uint16_t angle_of(uint16_t start, uint16_t end);
+static uint16_t build_node(buffer* nodes, int i0, int j0, int i1, int j1);
+static void write_bbox(buffer* nodes, int i0, int j0, int i1, int j1);
+static void build_blockmap(buffer* blockmap);
+static int min_i(int a, int b);
+static int max_i(int a, int b);
+static uint32_t hash(uint32_t x);
+
+static buffer* add_lump(const char* name);
+static void put_u8(buffer* b, uint8_t value);
+static void put_u16(buffer* b, uint16_t value);
+static void put_u32(buffer* b, uint32_t value);
+static void put_name(buffer* b, const char* name);
+static void put_bytes(buffer* b, const char* bytes, size_t size);
+static void copy_buffer(buffer* dst, const buffer* src);
+static bool write_wad(const char* filename);
+
+static int cols, rows, pieces, cell_size, num_things;
+static int origin_x, origin_y;
+static uint32_t seed;
+static const char* wall_name;
+
+static int num_vertices;
+static int16_t* vertex_xs;
+static int16_t* vertex_ys;
+static int num_lines;
+static line* lines;
+static uint16_t* line_sidedefs;	// Front and back sidedef of every line
+static uint16_t* line_segs;	// Seg on either side of every line, for GL partners
+static int* seg_lines;
+static int* seg_sides;
+static int num_segs;
+static uint16_t* block_lines;
+
+static out_lump lumps[MAX_LUMPS];
+static int num_lumps;
+
+// mapgen [-o file] [-map name] [-sectors n] [-pieces k] [-cell size] [-things n] [-seed n]
+//        [-wall name] [-floor name] [-ceiling name]
+// Writes a PWAD with one map: a grid of square sectors with stepped floors and ceilings, every
+// cell edge split into k collinear linedefs. Cells are convex, so the BSP needs no splits and each
+// cell is exactly one subsector; the vanilla SEGS/SSECTORS/NODES and the GL v2 lumps describe the
+// same tree. Texture names have to exist in the IWAD the map is played with
+int main(int argc, char** argv)
+{
+	args_init(argc, argv);
+
+	const char* output = args_get("-o") != NULL ? args_get("-o") : DEFAULT_OUTPUT;
+	const char* mapname = args_get("-map") != NULL ? args_get("-map") : DEFAULT_MAPNAME;
+	int num_sectors = args_get("-sectors") != NULL ? atoi(args_get("-sectors")) : DEFAULT_SECTORS;
+	pieces = args_get("-pieces") != NULL ? atoi(args_get("-pieces")) : 1;
+	cell_size = args_get("-cell") != NULL ? atoi(args_get("-cell")) : DEFAULT_CELL_SIZE;
+	num_things = args_get("-things") != NULL ? atoi(args_get("-things")) : 0;
+	seed = args_get("-seed") != NULL ? (uint32_t)strtoul(args_get("-seed"), NULL, 10) : 1993;
+	wall_name = args_get("-wall") != NULL ? args_get("-wall") : DEFAULT_WALL;
+	const char* floor_name = args_get("-floor") != NULL ? args_get("-floor") : DEFAULT_FLOOR;
+	const char* ceiling_name = args_get("-ceiling") != NULL ? args_get("-ceiling") : DEFAULT_CEILING;
+
+	if (num_sectors <= 0 || pieces <= 0 || num_things < 0 || strlen(mapname) > 5)
+	{
+		fprintf(stderr, "Invalid arguments, see the comment above main()\n");
+		return -1;
+	}
+	if (!is_cell_size_valid(cell_size, pieces))
+	{
+		fprintf(stderr, "Cell size %d can not be split into %d linedefs per edge\n", cell_size, pieces);
+		return -1;
+	}
+
+	// As square as possible
+	cols = (int)ceil(sqrt(num_sectors));
+	rows = (num_sectors + cols - 1) / cols;
+	if (rows * cols != num_sectors)
+	{
+		// Rectangles only, every cell needs its full set of neighbours for a BSP without splits
+		num_sectors = rows * cols;
+		printf("Rounded up to %d sectors (%dx%d)\n", num_sectors, cols, rows);
+	}
+
+	num_vertices = (cols + 1) * (rows + 1) + ((cols + 1) * rows + cols * (rows + 1)) * (pieces - 1);
+	num_lines = ((cols + 1) * rows + cols * (rows + 1)) * pieces;
+	int num_sidedefs = num_lines * 2 - (2 * cols + 2 * rows) * pieces;
+	num_segs = num_sectors * 4 * pieces;
+	long extent_x = (long)cols * cell_size, extent_y = (long)rows * cell_size;
+
+	if (num_vertices > MAX_VERTICES || num_lines > MAX_INDEX || num_sidedefs > MAX_INDEX || num_segs > MAX_INDEX ||
+		num_sectors > MAX_SUBSECTORS || extent_x > 2 * MAX_COORDINATE || extent_y > 2 * MAX_COORDINATE)
+	{
+		fprintf(stderr, "%d sectors with %d linedefs per edge exceed the limits of the format: %d vertices (max %d), "
+			"%d linedefs, %d sidedefs, %d segs (max %d each), %ldx%ld units (max %d)\n",
+			num_sectors, pieces, num_vertices, MAX_VERTICES, num_lines, num_sidedefs, num_segs, MAX_INDEX,
+			extent_x, extent_y, 2 * MAX_COORDINATE);
+		return -1;
+	}
+
+	// Centred on the origin, which doubles the usable coordinate range
+	origin_x = -(int)(extent_x / 2);
+	origin_y = -(int)(extent_y / 2);
+
+	build_vertices();
+	build_lines();
+
+	add_lump(mapname);
+
+	buffer* things = add_lump("THINGS");
+	put_u16(things, (uint16_t)(origin_x + cell_size / 2));
+	put_u16(things, (uint16_t)(origin_y + cell_size / 2));
+	put_u16(things, 0);
+	put_u16(things, THING_P1_START);
+	put_u16(things, THING_FLAGS_ALL_SKILLS);
+
+	// Monsters, items and decorations, so the thing count has something to load
+	static const uint16_t thing_types[] = { 3004, 3001, 2011, 2014, 2035, 2028 };
+	for (int i = 0; i < num_things; i++)
+	{
+		uint32_t h = hash(seed ^ (uint32_t)i * 2654435761u);
+		int cell = h % num_sectors;
+		int offset_x = (int)((h >> 8) % (cell_size / 2)) - cell_size / 4;
+		int offset_y = (int)((h >> 16) % (cell_size / 2)) - cell_size / 4;
+		put_u16(things, (uint16_t)(origin_x + (cell % cols) * cell_size + cell_size / 2 + offset_x));
+		put_u16(things, (uint16_t)(origin_y + (cell / cols) * cell_size + cell_size / 2 + offset_y));
+		put_u16(things, (uint16_t)((h >> 24) % 8 * 45));
+		put_u16(things, thing_types[h % (sizeof(thing_types) / sizeof(thing_types[0]))]);
+		put_u16(things, THING_FLAGS_ALL_SKILLS);
+	}
+
+	buffer* linedefs = add_lump("LINEDEFS");
+	buffer* sidedefs = add_lump("SIDEDEFS");
+	for (int i = 0; i < num_lines; i++)
+	{
+		const line* l = &lines[i];
+		bool is_two_sided = l->back != NO_INDEX;
+
+		put_u16(linedefs, l->v1);
+		put_u16(linedefs, l->v2);
+		put_u16(linedefs, is_two_sided ? LINEDEF_FLAGS_TWO_SIDED : LINEDEF_FLAGS_IMPASSABLE);
+		put_u16(linedefs, 0); // Special
+		put_u16(linedefs, 0); // Tag
+		put_u16(linedefs, line_sidedefs[i * 2]);
+		put_u16(linedefs, line_sidedefs[i * 2 + 1]);
+
+		for (int side = 0; side < (is_two_sided ? 2 : 1); side++)
+		{
+			// Offsets continue across the pieces of an edge
+			put_u16(sidedefs, (uint16_t)((i % pieces) * (cell_size / pieces)));
+			put_u16(sidedefs, 0);
+			put_name(sidedefs, is_two_sided ? wall_name : "-");
+			put_name(sidedefs, is_two_sided ? wall_name : "-");
+			put_name(sidedefs, is_two_sided ? "-" : wall_name);
+			put_u16(sidedefs, side == 0 ? l->front : l->back);
+		}
+	}
+
+	buffer* vertexes = add_lump("VERTEXES");
+	for (int i = 0; i < num_vertices; i++)
+	{
+		put_u16(vertexes, (uint16_t)vertex_xs[i]);
+		put_u16(vertexes, (uint16_t)vertex_ys[i]);
+	}
+
+	// Each cell clockwise: left edge up, top edge right, right edge down, bottom edge left
+	seg_lines = malloc(sizeof(int) * num_segs);
+	seg_sides = malloc(sizeof(int) * num_segs);
+	int seg = 0;
+	for (int j = 0; j < rows; j++)
+	{
+		for (int i = 0; i < cols; i++)
+		{
+			for (int p = 0; p < pieces; p++)
+				add_seg(seg++, vertical_line(i, j, p), 0);
+			for (int p = 0; p < pieces; p++)
+				add_seg(seg++, horizontal_line(i, j + 1, p), 0);
+			for (int p = pieces - 1; p >= 0; p--)
+				add_seg(seg++, vertical_line(i + 1, j, p), i + 1 == cols ? 0 : 1);
+			for (int p = pieces - 1; p >= 0; p--)
+				add_seg(seg++, horizontal_line(i, j, p), j == 0 ? 0 : 1);
+		}
+	}
+
+	// Segs cover whole linedefs, so every offset is 0
+	buffer* segs = add_lump("SEGS");
+	buffer gl_segs = { 0 };
+	for (int i = 0; i < num_segs; i++)
+	{
+		const line* l = &lines[seg_lines[i]];
+		int side = seg_sides[i];
+		uint16_t start = side == 0 ? l->v1 : l->v2;
+		uint16_t end = side == 0 ? l->v2 : l->v1;
+
+		put_u16(segs, start);
+		put_u16(segs, end);
+		put_u16(segs, angle_of(start, end));
+		put_u16(segs, (uint16_t)seg_lines[i]);
+		put_u16(segs, (uint16_t)side);
+		put_u16(segs, 0);
+
+		put_u16(&gl_segs, start);
+		put_u16(&gl_segs, end);
+		put_u16(&gl_segs, (uint16_t)seg_lines[i]);
+		put_u16(&gl_segs, (uint16_t)side);
+		put_u16(&gl_segs, line_segs[seg_lines[i] * 2 + 1 - side]);
+	}
+
+	buffer* subsectors = add_lump("SSECTORS");
+	for (int i = 0; i < num_sectors; i++)
+	{
+		put_u16(subsectors, (uint16_t)(4 * pieces));
+		put_u16(subsectors, (uint16_t)(i * 4 * pieces));
+	}
+
+	buffer* nodes = add_lump("NODES");
+	if (num_sectors > 1)
+		build_node(nodes, 0, 0, cols, rows);
+
+	// Floors step by at most 24 so the whole grid can be walked
+	buffer* sectors = add_lump("SECTORS");
+	for (int i = 0; i < num_sectors; i++)
+	{
+		uint32_t h = hash(seed + (uint32_t)i);
+		int16_t floor = (int16_t)((h % 4) * 8);
+		int16_t ceiling = (int16_t)(floor + 128 + ((h >> 4) % 3) * 32);
+		put_u16(sectors, (uint16_t)floor);
+		put_u16(sectors, (uint16_t)ceiling);
+		put_name(sectors, floor_name);
+		put_name(sectors, ceiling_name);
+		put_u16(sectors, (uint16_t)(128 + ((h >> 8) % 8) * 16));
+		put_u16(sectors, 0); // Special
+		put_u16(sectors, 0); // Tag
+	}
+
+	// Nothing is rejected, every sector may see every other
+	buffer* reject = add_lump("REJECT");
+	size_t reject_size = ((size_t)num_sectors * num_sectors + 7) / 8;
+	for (size_t i = 0; i < reject_size; i++)
+		put_u8(reject, 0);
+
+	build_blockmap(add_lump("BLOCKMAP"));
+
+	char gl_marker[9];
+	snprintf(gl_marker, sizeof(gl_marker), "GL_%s", mapname);
+	add_lump(gl_marker);
+
+	// No GL vertices, nothing is split
+	put_bytes(add_lump("GL_VERT"), "gNd2", 4);
+	*add_lump("GL_SEGS") = gl_segs;
+	copy_buffer(add_lump("GL_SSECT"), subsectors);
+	copy_buffer(add_lump("GL_NODES"), nodes);
+	add_lump("GL_PVS");
+
+	if (!write_wad(output))
+		return -1;
+
+	printf("Wrote %s: map %s, %d sectors (%dx%d), %d linedefs, %d sidedefs, %d vertices, %d segs, %d things\n",
+		output, mapname, num_sectors, cols, rows, num_lines, num_sidedefs, num_vertices, num_segs, num_things + 1);
+	return 0;
+}
+
+bool is_cell_size_valid(int cell_size, int pieces)
+{
+	return cell_size >= MIN_CELL_SIZE && cell_size % pieces == 0;
+}
+
+uint16_t corner(int i, int j)
+{
+	return (uint16_t)(j * (cols + 1) + i);
+}
+
+// Vertex p of the vertical edge at column i, row j, counted upwards
+uint16_t vertical_vertex(int i, int j, int p)
+{
+	if (p == 0)
+		return corner(i, j);
+	if (p == pieces)
+		return corner(i, j + 1);
+
+	int base = (cols + 1) * (rows + 1);
+	return (uint16_t)(base + (j * (cols + 1) + i) * (pieces - 1) + p - 1);
+}
+
+// Vertex p of the horizontal edge at column i, row j, counted to the right
+uint16_t horizontal_vertex(int i, int j, int p)
+{
+	if (p == 0)
+		return corner(i, j);
+	if (p == pieces)
+		return corner(i + 1, j);
+
+	int base = (cols + 1) * (rows + 1) + (cols + 1) * rows * (pieces - 1);
+	return (uint16_t)(base + (j * cols + i) * (pieces - 1) + p - 1);
+}
+
+int vertical_line(int i, int j, int p)
+{
+	return (j * (cols + 1) + i) * pieces + p;
+}
+
+int horizontal_line(int i, int j, int p)
+{
+	return (cols + 1) * rows * pieces + (j * cols + i) * pieces + p;
+}
+
+// The front of a line is on its right. Vertical lines run up with the cell to the east in front,
+// horizontal lines run right with the cell to the south in front, lines on the west and north
+// borders. Lines on the east and south borders are reversed so their only cell is in front
+void build_lines()
+{
+	lines = malloc(sizeof(line) * num_lines);
+	line_sidedefs = malloc(sizeof(uint16_t) * num_lines * 2);
+	line_segs = malloc(sizeof(uint16_t) * num_lines * 2);
+
+	for (int j = 0; j < rows; j++)
+	{
+		for (int i = 0; i <= cols; i++)
+		{
+			for (int p = 0; p < pieces; p++)
+			{
+				uint16_t a = vertical_vertex(i, j, p), b = vertical_vertex(i, j, p + 1);
+				if (i < cols)
+					lines[vertical_line(i, j, p)] = (line){ a, b, (uint16_t)(j * cols + i), i > 0 ? (uint16_t)(j * cols + i - 1) : NO_INDEX };
+				else
+					lines[vertical_line(i, j, p)] = (line){ b, a, (uint16_t)(j * cols + cols - 1), NO_INDEX };
+			}
+		}
+	}
+
+	for (int j = 0; j <= rows; j++)
+	{
+		for (int i = 0; i < cols; i++)
+		{
+			for (int p = 0; p < pieces; p++)
+			{
+				uint16_t a = horizontal_vertex(i, j, p), b = horizontal_vertex(i, j, p + 1);
+				if (j > 0)
+					lines[horizontal_line(i, j, p)] = (line){ a, b, (uint16_t)((j - 1) * cols + i), j < rows ? (uint16_t)(j * cols + i) : NO_INDEX };
+				else
+					lines[horizontal_line(i, j, p)] = (line){ b, a, (uint16_t)i, NO_INDEX };
+			}
+		}
+	}
+
+	uint16_t next = 0;
+	for (int i = 0; i < num_lines; i++)
+	{
+		line_sidedefs[i * 2] = next++;
+		line_sidedefs[i * 2 + 1] = lines[i].back != NO_INDEX ? next++ : NO_INDEX;
+		line_segs[i * 2] = line_segs[i * 2 + 1] = NO_INDEX;
+	}
+}
+
+void add_seg(int index, int line_index, int side)
+{
+	seg_lines[index] = line_index;
+	seg_sides[index] = side;
+	line_segs[line_index * 2 + side] = (uint16_t)index;
+}
+
+// Corners first, then the inner vertices of vertical edges, then those of horizontal edges
+void build_vertices()
+{
+	vertex_xs = malloc(sizeof(int16_t) * num_vertices);
+	vertex_ys = malloc(sizeof(int16_t) * num_vertices);
+
+	int n = 0;
+	for (int j = 0; j <= rows; j++)
+	{
+		for (int i = 0; i <= cols; i++, n++)
+		{
+			vertex_xs[n] = (int16_t)(origin_x + i * cell_size);
+			vertex_ys[n] = (int16_t)(origin_y + j * cell_size);
+		}
+	}
+	for (int j = 0; j < rows; j++)
+	{
+		for (int i = 0; i <= cols; i++)
+		{
+			for (int p = 1; p < pieces; p++, n++)
+			{
+				vertex_xs[n] = (int16_t)(origin_x + i * cell_size);
+				vertex_ys[n] = (int16_t)(origin_y + j * cell_size + p * (cell_size / pieces));
+			}
+		}
+	}
+	for (int j = 0; j <= rows; j++)
+	{
+		for (int i = 0; i < cols; i++)
+		{
+			for (int p = 1; p < pieces; p++, n++)
+			{
+				vertex_xs[n] = (int16_t)(origin_x + i * cell_size + p * (cell_size / pieces));
+				vertex_ys[n] = (int16_t)(origin_y + j * cell_size);
+			}
+		}
+	}
+}
+
+// Binary angle, 0x4000 is north
+uint16_t angle_of(uint16_t start, uint16_t end)
+{
+	double angle = atan2(vertex_ys[end] - vertex_ys[start], vertex_xs[end] - vertex_xs[start]);
+	return (uint16_t)(int32_t)lround(angle / 6.28318530718 * 65536.0);
+}
+
+// Halves the larger side of the block of cells until single cells remain, children come before
+// their parent so the root is the last node
+uint16_t build_node(buffer* nodes, int i0, int j0, int i1, int j1)
+{
+	if (i1 - i0 == 1 && j1 - j0 == 1)
+		return (uint16_t)(0x8000 | (j0 * cols + i0));
+
+	bool is_vertical = i1 - i0 >= j1 - j0;
+	int mid = is_vertical ? (i0 + i1) / 2 : (j0 + j1) / 2;
+
+	// Front is the east half of a vertical split and the south half of a horizontal one
+	uint16_t front, back;
+	if (is_vertical)
+	{
+		front = build_node(nodes, mid, j0, i1, j1);
+		back = build_node(nodes, i0, j0, mid, j1);
+	}
+	else
+	{
+		front = build_node(nodes, i0, j0, i1, mid);
+		back = build_node(nodes, i0, mid, i1, j1);
+	}
+
+	uint16_t index = (uint16_t)(nodes->size / 28);
+	if (is_vertical)
+	{
+		put_u16(nodes, (uint16_t)(origin_x + mid * cell_size));
+		put_u16(nodes, (uint16_t)(origin_y + j0 * cell_size));
+		put_u16(nodes, 0);
+		put_u16(nodes, (uint16_t)cell_size);
+		write_bbox(nodes, mid, j0, i1, j1);
+		write_bbox(nodes, i0, j0, mid, j1);
+	}
+	else
+	{
+		put_u16(nodes, (uint16_t)(origin_x + i0 * cell_size));
+		put_u16(nodes, (uint16_t)(origin_y + mid * cell_size));
+		put_u16(nodes, (uint16_t)cell_size);
+		put_u16(nodes, 0);
+		write_bbox(nodes, i0, j0, i1, mid);
+		write_bbox(nodes, i0, mid, i1, j1);
+	}
+	put_u16(nodes, front);
+	put_u16(nodes, back);
+
+	return index;
+}
+
+// Top, bottom, left, right
+void write_bbox(buffer* nodes, int i0, int j0, int i1, int j1)
+{
+	put_u16(nodes, (uint16_t)(origin_y + j1 * cell_size));
+	put_u16(nodes, (uint16_t)(origin_y + j0 * cell_size));
+	put_u16(nodes, (uint16_t)(origin_x + i0 * cell_size));
+	put_u16(nodes, (uint16_t)(origin_x + i1 * cell_size));
+}
+
+// Every line is listed in each 128 unit block its bounding box touches
+void build_blockmap(buffer* blockmap)
+{
+	int block_cols = cols * cell_size / BLOCK_SIZE + 1;
+	int block_rows = rows * cell_size / BLOCK_SIZE + 1;
+	int num_blocks = block_cols * block_rows;
+
+	int* counts = calloc(num_blocks, sizeof(int));
+	int* starts = malloc(sizeof(int) * (num_blocks + 1));
+	for (int pass = 0; pass < 2; pass++)
+	{
+		int* fill = pass == 0 ? counts : malloc(sizeof(int) * num_blocks);
+		if (pass == 1)
+		{
+			starts[0] = 0;
+			for (int i = 0; i < num_blocks; i++)
+				starts[i + 1] = starts[i] + counts[i];
+			memcpy(fill, starts, sizeof(int) * num_blocks);
+			block_lines = malloc(sizeof(uint16_t) * (starts[num_blocks] > 0 ? starts[num_blocks] : 1));
+		}
+
+		for (int i = 0; i < num_lines; i++)
+		{
+			const line* l = &lines[i];
+			int x0 = (min_i(vertex_xs[l->v1], vertex_xs[l->v2]) - origin_x) / BLOCK_SIZE;
+			int x1 = (max_i(vertex_xs[l->v1], vertex_xs[l->v2]) - origin_x) / BLOCK_SIZE;
+			int y0 = (min_i(vertex_ys[l->v1], vertex_ys[l->v2]) - origin_y) / BLOCK_SIZE;
+			int y1 = (max_i(vertex_ys[l->v1], vertex_ys[l->v2]) - origin_y) / BLOCK_SIZE;
+			for (int y = y0; y <= y1 && y < block_rows; y++)
+			{
+				for (int x = x0; x <= x1 && x < block_cols; x++)
+				{
+					if (pass == 0)
+						fill[y * block_cols + x]++;
+					else
+						block_lines[fill[y * block_cols + x]++] = (uint16_t)i;
+				}
+			}
+		}
+
+		if (pass == 1)
+			free(fill);
+	}
+
+	// Offsets are in 16-bit words, each list starts with 0 and ends with -1
+	size_t num_words = 4 + (size_t)num_blocks + 2 * (size_t)num_blocks + starts[num_blocks];
+	if (num_words > 0xffff)
+	{
+		fprintf(stderr, "BLOCKMAP needs %zu words, more than 16-bit offsets can address, leaving it empty\n", num_words);
+	}
+	else
+	{
+		put_u16(blockmap, (uint16_t)origin_x);
+		put_u16(blockmap, (uint16_t)origin_y);
+		put_u16(blockmap, (uint16_t)block_cols);
+		put_u16(blockmap, (uint16_t)block_rows);
+
+		size_t offset = 4 + num_blocks;
+		for (int i = 0; i < num_blocks; i++)
+		{
+			put_u16(blockmap, (uint16_t)offset);
+			offset += 2 + counts[i];
+		}
+		for (int i = 0; i < num_blocks; i++)
+		{
+			put_u16(blockmap, 0);
+			for (int j = starts[i]; j < starts[i + 1]; j++)
+				put_u16(blockmap, block_lines[j]);
+			put_u16(blockmap, 0xffff);
+		}
+	}
+
+	free(counts);
+	free(starts);
+	free(block_lines);
+}
+
+int min_i(int a, int b)
+{
+	return a < b ? a : b;
+}
+
+int max_i(int a, int b)
+{
+	return a > b ? a : b;
+}
+
+// lowbias32, the same seed gives the same map on every platform
+uint32_t hash(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+buffer* add_lump(const char* name)
+{
+	if (num_lumps == MAX_LUMPS)
+	{
+		fprintf(stderr, "Too many lumps\n");
+		exit(-1);
+	}
+
+	out_lump* lump = &lumps[num_lumps++];
+	memset(lump->name, 0, sizeof(lump->name));
+	for (int i = 0; i < 8 && name[i] != 0; i++)
+		lump->name[i] = (char)toupper((unsigned char)name[i]);
+	lump->data = (buffer){ 0 };
+	return &lump->data;
+}
+
+void put_u8(buffer* b, uint8_t value)
+{
+	if (b->size == b->capacity)
+	{
+		b->capacity = b->capacity > 0 ? b->capacity * 2 : 256;
+		b->data = realloc(b->data, b->capacity);
+	}
+	b->data[b->size++] = value;
+}
+
+void put_u16(buffer* b, uint16_t value)
+{
+	put_u8(b, value & 0xff);
+	put_u8(b, value >> 8);
+}
+
+void put_u32(buffer* b, uint32_t value)
+{
+	put_u16(b, value & 0xffff);
+	put_u16(b, value >> 16);
+}
+
+// Lump and texture names, upper case and padded with zeros to 8 bytes
+void put_name(buffer* b, const char* name)
+{
+	size_t length = strlen(name);
+	for (size_t i = 0; i < 8; i++)
+		put_u8(b, i < length ? (uint8_t)toupper((unsigned char)name[i]) : 0);
+}
+
+void put_bytes(buffer* b, const char* bytes, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		put_u8(b, (uint8_t)bytes[i]);
+}
+
+void copy_buffer(buffer* dst, const buffer* src)
+{
+	for (size_t i = 0; i < src->size; i++)
+		put_u8(dst, src->data[i]);
+}
+
+bool write_wad(const char* filename)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open '%s' for writing\n", filename);
+		return false;
+	}
+
+	buffer header = { 0 };
+	uint32_t directory_offset = 12;
+	for (int i = 0; i < num_lumps; i++)
+		directory_offset += (uint32_t)lumps[i].data.size;
+
+	put_bytes(&header, "PWAD", 4);
+	put_u32(&header, (uint32_t)num_lumps);
+	put_u32(&header, directory_offset);
+	fwrite(header.data, 1, header.size, file);
+
+	buffer directory = { 0 };
+	uint32_t offset = 12;
+	for (int i = 0; i < num_lumps; i++)
+	{
+		if (lumps[i].data.size > 0)
+			fwrite(lumps[i].data.data, 1, lumps[i].data.size, file);
+
+		put_u32(&directory, offset);
+		put_u32(&directory, (uint32_t)lumps[i].data.size);
+		for (int j = 0; j < 8; j++)
+			put_u8(&directory, (uint8_t)lumps[i].name[j]);
+		offset += (uint32_t)lumps[i].data.size;
+	}
+	fwrite(directory.data, 1, directory.size, file);
+
+	bool is_ok = ferror(file) == 0;
+	fclose(file);
+	free(header.data);
+	free(directory.data);
+	return is_ok;
+}
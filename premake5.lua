@@ -19,4 +19,6 @@ group "Dependencies"
     include "vendor/glad/Build-Glad.lua"
 group ""
 
-include "Doom/Build_Doom.lua"
\ No newline at end of file
+include "Doom/Build_Doom.lua"
+include "Bench/Build_Bench.lua"
+include "MapGen/Build_MapGen.lua"
\ No newline at end of file